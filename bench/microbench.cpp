@@ -0,0 +1,222 @@
+// Micro-benchmarks of the hot paths of the solver, on jobs from samples.cfg.
+// Build with `make microbench`, run from the repository root: ./wfc_microbench [samples.cfg]
+
+#include "alloc_tracker.hh"
+#include "model_functions.hh"
+
+// Results go here, so the compiler cannot optimize away the calls we time.
+static volatile size_t s_sink = 0;
+
+const size_t kWarmupSamples = 3;
+const size_t kSamples       = 15;
+
+// Times only what happens between start() and stop(), so each sample can do untimed setup first.
+class Stopwatch
+{
+public:
+	void start()
+	{
+		_start_allocations = num_allocations();
+		_start_bytes       = num_bytes_allocated();
+		_start_time        = std::chrono::steady_clock::now();
+	}
+
+	// ops = how many operations were done since start().
+	void stop(size_t ops)
+	{
+		const auto end_time = std::chrono::steady_clock::now();
+		_ns          += std::chrono::duration<double, std::nano>(end_time - _start_time).count();
+		_allocations += num_allocations() - _start_allocations;
+		_bytes       += num_bytes_allocated() - _start_bytes;
+		_ops         += ops;
+	}
+
+	double ns_per_op()          const { return _ns / std::max<size_t>(_ops, 1); }
+	double allocations_per_op() const { return double(_allocations) / std::max<size_t>(_ops, 1); }
+	double bytes_per_op()       const { return double(_bytes) / std::max<size_t>(_ops, 1); }
+
+private:
+	std::chrono::steady_clock::time_point _start_time;
+	size_t _start_allocations = 0;
+	size_t _start_bytes       = 0;
+	double _ns                = 0;
+	size_t _allocations       = 0;
+	size_t _bytes             = 0;
+	size_t _ops               = 0;
+};
+
+// Runs sample(stopwatch) kWarmupSamples times, then kSamples times, and prints ns/op statistics
+// over the samples, and allocations per op.
+template<typename Fun>
+void benchmark(const std::string& name, const Fun& sample)
+{
+	for (size_t i = 0; i < kWarmupSamples; ++i) {
+		Stopwatch stopwatch;
+		sample(stopwatch);
+	}
+
+	std::vector<double> ns_per_op;
+	double bytes_per_op = 0;
+	double allocations_per_op = 0;
+	for (size_t i = 0; i < kSamples; ++i) {
+		Stopwatch stopwatch;
+		sample(stopwatch);
+		ns_per_op.push_back(stopwatch.ns_per_op());
+		bytes_per_op       += stopwatch.bytes_per_op() / kSamples;
+		allocations_per_op += stopwatch.allocations_per_op() / kSamples;
+	}
+
+	std::sort(ns_per_op.begin(), ns_per_op.end());
+	const double mean = calc_sum(ns_per_op) / ns_per_op.size();
+	double variance = 0;
+	for (const double ns : ns_per_op) {
+		variance += (ns - mean) * (ns - mean) / ns_per_op.size();
+	}
+
+	printf("%-40s %12.1f %12.1f %12.1f %8.1f%% %12.1f %10.2f\n", name.c_str(),
+	       ns_per_op[ns_per_op.size() / 2], ns_per_op.front(), ns_per_op.back(),
+	       100.0 * std::sqrt(variance) / mean, bytes_per_op, allocations_per_op);
+	fflush(stdout);
+}
+
+// ----------------------------------------------------------------------------
+
+const size_t kObservationsPerSample = 50;
+
+// Time the propagation after each of the first kObservationsPerSample observations of an attempt.
+void benchmark_propagate(const std::string& name, const Model& model)
+{
+	Output output;
+	uint64_t seed = 0;
+	benchmark(name + " propagate", [&](Stopwatch& stopwatch) {
+		reset_output(model, &output);
+		RandomEngine rng(seed++);
+		init_heap(model, &output, rng);
+		for (size_t i = 0; i < kObservationsPerSample; ++i) {
+			if (observe(model, &output, rng) != Result::kUnfinished) { break; }
+			stopwatch.start();
+			while (model.propagate(&output));
+			stopwatch.stop(1);
+		}
+	});
+}
+
+// An attempt after kObservationsPerSample observations.
+Output partly_solved(const Model& model)
+{
+	Output output;
+	reset_output(model, &output);
+	RandomEngine rng(0);
+	init_heap(model, &output, rng);
+	for (size_t i = 0; i < kObservationsPerSample; ++i) {
+		if (observe(model, &output, rng) != Result::kUnfinished) { break; }
+		while (model.propagate(&output));
+	}
+	return output;
+}
+
+void benchmark_find_lowest_entropy(const std::string& name, const Model& model)
+{
+	const Output output = partly_solved(model);
+	const size_t kCallsPerSample = 10000;
+	benchmark(name + " find_lowest_entropy", [&](Stopwatch& stopwatch) {
+		int x = 0, y = 0;
+		stopwatch.start();
+		for (size_t i = 0; i < kCallsPerSample; ++i) {
+			find_lowest_entropy(model, output, &x, &y);
+			s_sink += x + y;
+		}
+		stopwatch.stop(kCallsPerSample);
+	});
+}
+
+void benchmark_spin_the_bottle(const std::string& name, const Model& model)
+{
+	// A cell where every pattern is still possible:
+	const BitArray3D wave(1, 1, model._num_patterns, true);
+	const double sum = calc_sum(model._pattern_weight);
+	const size_t kCallsPerSample = 10000;
+	RandomEngine rng(0);
+	benchmark(name + " spin_the_bottle", [&](Stopwatch& stopwatch) {
+		stopwatch.start();
+		for (size_t i = 0; i < kCallsPerSample; ++i) {
+			s_sink += spin_the_bottle(wave.words(0, 0), wave.num_words(), model._pattern_weight, sum,
+			                          rng.next_double());
+		}
+		stopwatch.stop(kCallsPerSample);
+	});
+}
+
+void benchmark_overlapping(const std::string& image_dir, const std::string& name, const configuru::Config& config)
+{
+	const auto model = make_overlapping(image_dir, config);
+	const auto& overlapping = static_cast<const OverlappingModel&>(*model);
+
+	benchmark_propagate(name, *model);
+	benchmark_find_lowest_entropy(name, *model);
+	benchmark_spin_the_bottle(name, *model);
+
+	const auto sample_image = load_paletted_image(image_dir + config["image"].as_string());
+	const int  n            = config.get_or("n",            3);
+	const bool periodic_in  = config.get_or("periodic_in",  true);
+	const int  symmetry     = config.get_or("symmetry",     8);
+	const bool foundation   = config.get_or("foundation",   false);
+	benchmark(name + " extract_patterns", [&](Stopwatch& stopwatch) {
+		PatternHash lowest_pattern;
+		stopwatch.start();
+		const auto patterns = extract_patterns(sample_image, n, periodic_in, symmetry,
+		                                       foundation ? &lowest_pattern : nullptr);
+		stopwatch.stop(1);
+		s_sink += patterns.size();
+	});
+
+	// Render an attempt which is partly solved, so some cells are still a blend of patterns:
+	const Graphics graphics = overlapping.graphics(partly_solved(*model));
+	benchmark(name + " image_from_graphics", [&](Stopwatch& stopwatch) {
+		stopwatch.start();
+		const auto image = image_from_graphics(graphics, sample_image.palette);
+		stopwatch.stop(1);
+		s_sink += image.width();
+	});
+
+	const Image image = image_from_graphics(graphics, sample_image.palette);
+	benchmark(name + " upsample", [&](Stopwatch& stopwatch) {
+		stopwatch.start();
+		const auto upsampled = upsample(image);
+		stopwatch.stop(1);
+		s_sink += upsampled.width();
+	});
+}
+
+void benchmark_tiled(const std::string& image_dir, const std::string& name, const configuru::Config& config)
+{
+	const auto model = make_tiled(image_dir, config);
+	benchmark_propagate(name, *model);
+	benchmark_find_lowest_entropy(name, *model);
+	benchmark_spin_the_bottle(name, *model);
+}
+
+int main(int argc, char* argv[])
+{
+	loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+	alloc_tracking_enabled() = true; // So we can report bytes allocated per op.
+	loguru::init(argc, argv);
+
+	const std::string path = argc > 1 ? argv[1] : "samples.cfg";
+	const auto samples = configuru::parse_file(path, configuru::CFG);
+	const auto image_dir = samples["image_dir"].as_string();
+
+	printf("%d warmup samples and %d samples each. ns/op: median, min and max over the samples, and the\n"
+	       "standard deviation in percent of the mean. Bytes and allocations are the mean per op.\n\n",
+	       int(kWarmupSamples), int(kSamples));
+	printf("%-40s %12s %12s %12s %9s %12s %10s\n",
+	       "benchmark", "ns/op", "min", "max", "stddev", "bytes/op", "allocs/op");
+
+	for (const auto& name : {"knot", "flowers", "rooms"}) {
+		benchmark_overlapping(image_dir, name, samples["overlapping"][name]);
+	}
+
+	for (const auto& name : {"summer", "knots_standard"}) {
+		benchmark_tiled(image_dir, std::string("tiled ") + name, samples["tiled"][name]);
+	}
+}
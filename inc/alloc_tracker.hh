@@ -0,0 +1,22 @@
+#ifndef ALLOC_TRACKER_HH
+#define ALLOC_TRACKER_HH
+
+#include <cstddef>
+#include <cstdint>
+
+// alloc_tracker.cpp replaces the global operator new and delete. Once tracking is enabled they
+// count every allocation, and add it to the active phase of current_bench(), if any. See --allocs.
+
+// Set once, before starting any threads. Off by default, when new and delete cost one branch more.
+inline bool& alloc_tracking_enabled()
+{
+	static bool enabled = false;
+	return enabled;
+}
+
+// Since tracking was enabled, over all threads:
+size_t  num_allocations();
+size_t  num_bytes_allocated();
+int64_t num_live_bytes(); // Allocated minus freed. Always zero unless on glibc or macOS.
+
+#endif /* ALLOC_TRACKER_HH */
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 
 template<typename T>
@@ -63,4 +65,81 @@ private:
 	std::vector<T> _data;
 };
 
+// Many lists of varying length, stored back to back in one buffer (compressed sparse row).
+// Lists are appended one at a time: push_back() the values of a list, then end_list().
+template<typename T>
+struct ListArray
+{
+public:
+	struct Range
+	{
+		const T* _begin;
+		const T* _end;
+
+		const T* begin() const { return _begin; }
+		const T* end()   const { return _end;   }
+		size_t   size()  const { return _end - _begin; }
+	};
+
+	ListArray() : _offsets(1, 0) {}
+
+	inline void push_back(const T& value) { _values.push_back(value); }
+	inline void end_list() { _offsets.push_back(_values.size()); }
+
+	inline Range list(size_t i) const
+	{
+		DCHECK_LT_F(i + 1, _offsets.size());
+		return Range{_values.data() + _offsets[i], _values.data() + _offsets[i + 1]};
+	}
+
+	inline size_t num_lists()  const { return _offsets.size() - 1; }
+	inline size_t num_values() const { return _values.size(); }
+
+	void shrink_to_fit()
+	{
+		_offsets.shrink_to_fit();
+		_values.shrink_to_fit();
+	}
+
+	// Binary (de)serialization, in native byte order.
+	bool write(FILE* file) const
+	{
+		const uint64_t sizes[2] = { _offsets.size(), _values.size() };
+		return fwrite(sizes, sizeof(sizes), 1, file) == 1
+		    && fwrite(_offsets.data(), sizeof(uint32_t), _offsets.size(), file) == _offsets.size()
+		    && fwrite(_values.data(), sizeof(T), _values.size(), file) == _values.size();
+	}
+
+	// Expects num_lists lists, each of strictly increasing values below value_limit, as lists
+	// pushed in order are. Returns false on a read error, or if the data does not fit that.
+	bool read(FILE* file, size_t num_lists, size_t value_limit)
+	{
+		uint64_t sizes[2];
+		if (fread(sizes, sizeof(sizes), 1, file) != 1
+		    || sizes[0] != num_lists + 1 || sizes[1] > num_lists * value_limit) {
+			return false;
+		}
+		_offsets.resize(sizes[0]);
+		_values.resize(sizes[1]);
+		if (fread(_offsets.data(), sizeof(uint32_t), _offsets.size(), file) != _offsets.size()
+		    || fread(_values.data(), sizeof(T), _values.size(), file) != _values.size()) {
+			return false;
+		}
+
+		if (_offsets.front() != 0 || _offsets.back() != _values.size()) { return false; }
+		for (size_t i = 0; i + 1 < _offsets.size(); ++i) {
+			if (_offsets[i] > _offsets[i + 1]) { return false; }
+			for (size_t j = _offsets[i]; j < _offsets[i + 1]; ++j) {
+				if (!(static_cast<size_t>(_values[j]) < value_limit)) { return false; }
+				if (j > _offsets[i] && !(_values[j - 1] < _values[j])) { return false; }
+			}
+		}
+		return true;
+	}
+
+private:
+	std::vector<uint32_t> _offsets; // num_lists + 1. List i is _values[_offsets[i], _offsets[i + 1]).
+	std::vector<T>        _values;
+};
+
 #endif /* ARRAYS_HPP */
\ No newline at end of file
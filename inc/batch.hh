@@ -0,0 +1,26 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+#include "model_functions.hh"
+
+// Called with every finished output, on the thread that made it, as soon as it is done.
+// index is the number of the output image, 0 .. num_outputs - 1.
+using BatchWriter = std::function<void(size_t index, const Output& output)>;
+
+struct BatchStats
+{
+	size_t num_outputs        = 0; // Successful ones.
+	size_t num_attempts       = 0;
+	size_t num_contradictions = 0;
+	double seconds            = 0;
+	SolverCounters counters; // Summed over every attempt.
+};
+
+// Make num_outputs images from one model on num_threads threads. The model is shared, read-only.
+// Each thread keeps its own Output and reuses it for every attempt.
+// Image number i is tried with the same seeds as screenshot i, so it is the same image.
+// Gives up on an image after kMaxAttempts attempts.
+BatchStats run_batch(const Model& model, uint64_t job_seed, const SolverOptions& solver, size_t num_outputs,
+                     size_t num_threads, const BatchWriter& writer);
+
+#endif /* BATCH_HH */
@@ -0,0 +1,99 @@
+#ifndef BENCH_HH
+#define BENCH_HH
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "perf_counters.hh"
+#include "trace.hh"
+
+// Where --bench says the time went.
+enum class Phase
+{
+	kImageLoad,
+	kPatternExtraction,
+	kPropagatorBuild,   // Building the model, apart from loading images and extracting patterns.
+	kObserve,
+	kPropagate,
+	kRender,            // Model::image()
+	kEncode,            // PNG and GIF
+};
+
+const size_t kNumPhases = 7;
+
+const char* phase2str(Phase phase);
+
+// What --bench measures about one job.
+struct BenchStats
+{
+	double seconds[kNumPhases] = {}; // Excluding the time of nested phases.
+	double total_seconds       = 0;
+	size_t num_attempts        = 0;
+	size_t num_successes       = 0;
+	size_t num_iterations      = 0; // Observations, over all attempts.
+	size_t num_propagate_calls = 0; // Calls to Model::propagate(), see propagate_all().
+	size_t num_backtracks      = 0;
+	size_t num_rollbacks       = 0;
+
+	// With --allocs, see alloc_tracker.hh. The last entry is for allocations outside any phase.
+	size_t  num_allocations[kNumPhases + 1] = {};
+	size_t  bytes_allocated[kNumPhases + 1] = {};
+	int64_t peak_live_bytes = 0; // Over all threads, while running the job.
+
+	// With --perf, if perf->ok(). Excluding nested phases, like seconds.
+	// Every phase switch reads the counters, and perf_counts has perf->read_cost() subtracted for
+	// each read, but what is left of the measuring (cache and branch predictor state) still counts.
+	PerfCounters* perf = nullptr;
+	uint64_t      perf_counts[kNumPhases][kNumPerfEvents] = {};
+	uint64_t      perf_total[kNumPerfEvents]              = {}; // Over the whole job, reads included.
+	size_t        num_perf_reads                          = 0;
+
+	// Used by PhaseTimer:
+	int                                   active_phase = -1; // Or -1 for none.
+	std::chrono::steady_clock::time_point active_since;
+	uint64_t                              perf_since[kNumPerfEvents] = {};
+};
+
+// End the active phase of stats, if any, and start phase (or none, if -1).
+void switch_phase(BenchStats* stats, int phase);
+
+// The stats of the job this thread is working on, or nullptr when not benchmarking.
+inline BenchStats*& current_bench()
+{
+	static thread_local BenchStats* stats = nullptr;
+	return stats;
+}
+
+// Adds the time until it goes out of scope to a phase of current_bench(), if any.
+// A timer inside another one pauses the outer one, so no time is counted twice.
+// Also records the phase to the --trace timeline, if enabled.
+class PhaseTimer
+{
+public:
+	explicit PhaseTimer(Phase phase) : _trace(phase2str(phase), TraceKind::kPhase), _stats(current_bench())
+	{
+		if (!_stats) { return; }
+		_outer_phase = _stats->active_phase;
+		switch_phase(_stats, static_cast<int>(phase));
+	}
+
+	~PhaseTimer()
+	{
+		if (!_stats) { return; }
+		switch_phase(_stats, _outer_phase);
+	}
+
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+	TraceScope  _trace;
+	BenchStats* _stats;
+	int         _outer_phase = -1;
+};
+
+// One JSON object with everything in stats. Returns false on failure.
+bool write_bench_json(const std::string& path, const std::string& job_name, const BenchStats& stats);
+
+#endif /* BENCH_HH */
@@ -0,0 +1,143 @@
+#ifndef BIT_ARRAY_HPP
+#define BIT_ARRAY_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using Word = uint64_t;
+
+const size_t kBitsPerWord = 64;
+
+inline size_t num_words_for(size_t num_bits) { return (num_bits + kBitsPerWord - 1) / kBitsPerWord; }
+
+inline bool get_bit(const Word* words, size_t bit)
+{
+	return (words[bit / kBitsPerWord] >> (bit % kBitsPerWord)) & 1;
+}
+
+inline void set_bit(Word* words, size_t bit, bool value)
+{
+	const Word mask = Word(1) << (bit % kBitsPerWord);
+	if (value) { words[bit / kBitsPerWord] |=  mask; }
+	else       { words[bit / kBitsPerWord] &= ~mask; }
+}
+
+// Number of set bits.
+inline size_t count_bits(const Word* words, size_t num_words)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < num_words; ++i) {
+		count += __builtin_popcountll(words[i]);
+	}
+	return count;
+}
+
+// Index of the first set bit at or after start, or num_words * kBitsPerWord if there is none.
+inline size_t find_next_bit(const Word* words, size_t num_words, size_t start)
+{
+	size_t i = start / kBitsPerWord;
+	if (i >= num_words) { return num_words * kBitsPerWord; }
+	Word word = words[i] & (~Word(0) << (start % kBitsPerWord));
+	while (word == 0) {
+		if (++i == num_words) { return num_words * kBitsPerWord; }
+		word = words[i];
+	}
+	return i * kBitsPerWord + __builtin_ctzll(word);
+}
+
+inline size_t find_first_bit(const Word* words, size_t num_words)
+{
+	return find_next_bit(words, num_words, 0);
+}
+
+// Calls fun(bit) for every set bit, in increasing order.
+template<typename Fun>
+inline void for_each_bit(const Word* words, size_t num_words, const Fun& fun)
+{
+	for (size_t i = 0; i < num_words; ++i) {
+		Word word = words[i];
+		while (word != 0) {
+			fun(i * kBitsPerWord + __builtin_ctzll(word));
+			word &= word - 1;
+		}
+	}
+}
+
+// any_and() handles kWordsPerBlock words per step: one 256-bit AVX2 register, or two SSE2
+// registers. The branch-free block body lets the compiler vectorize it.
+const size_t kWordsPerBlock = 4;
+
+// Is (a & b) != 0 ? The inner loop of TileModel::propagate_sweep(). Queue propagation does not use it.
+inline bool any_and(const Word* a, const Word* b, size_t num_words)
+{
+	size_t i = 0;
+	for (; i + kWordsPerBlock <= num_words; i += kWordsPerBlock) {
+		const Word any = (a[i    ] & b[i    ]) | (a[i + 1] & b[i + 1])
+		               | (a[i + 2] & b[i + 2]) | (a[i + 3] & b[i + 3]);
+		if (any) { return true; }
+	}
+	for (; i < num_words; ++i) {
+		if (a[i] & b[i]) { return true; }
+	}
+	return false;
+}
+
+// A _width X _height grid of _depth bits each, packed into whole words per x, y.
+// The padding bits at the end of each x, y are always zero.
+struct BitArray3D
+{
+public:
+	BitArray3D() : _width(0), _height(0), _depth(0), _num_words(0) {}
+	BitArray3D(size_t w, size_t h, size_t d, bool value = false)
+		: _width(w), _height(h), _depth(d), _num_words(num_words_for(d)), _data(w * h * _num_words, 0)
+	{
+		if (value && _num_words > 0) {
+			std::vector<Word> all(_num_words, ~Word(0));
+			if (d % kBitsPerWord != 0) {
+				all.back() = (Word(1) << (d % kBitsPerWord)) - 1;
+			}
+			for (size_t i = 0; i < w * h; ++i) {
+				std::copy(all.begin(), all.end(), &_data[i * _num_words]);
+			}
+		}
+	}
+
+	const size_t index(size_t x, size_t y) const
+	{
+		DCHECK_LT_F(x, _width);
+		DCHECK_LT_F(y, _height);
+		return (x * _height + y) * _num_words;
+	}
+
+	inline       Word* mut_words(size_t x, size_t y)       { return &_data[index(x, y)]; }
+	inline const Word*     words(size_t x, size_t y) const { return &_data[index(x, y)]; }
+
+	inline bool get(size_t x, size_t y, size_t z) const
+	{
+		DCHECK_LT_F(z, _depth);
+		return get_bit(words(x, y), z);
+	}
+
+	inline void set(size_t x, size_t y, size_t z, bool value)
+	{
+		DCHECK_LT_F(z, _depth);
+		set_bit(mut_words(x, y), z, value);
+	}
+
+	inline size_t count(size_t x, size_t y) const { return count_bits(words(x, y), _num_words); }
+
+	template<typename Fun>
+	inline void for_each(size_t x, size_t y, const Fun& fun) const { for_each_bit(words(x, y), _num_words, fun); }
+
+	inline size_t num_words() const { return _num_words; }
+	inline size_t size()      const { return _data.size(); }
+
+private:
+	size_t _width, _height, _depth, _num_words;
+	std::vector<Word> _data;
+};
+
+#endif /* BIT_ARRAY_HPP */
@@ -3,11 +3,17 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <random>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -20,6 +26,11 @@
 #include <stb_image_write.h>
 
 #include "arrays.hpp"
+#include "bench.hh"
+#include "bit_array.hpp"
+#include "indexed_heap.hpp"
+#include "random.hpp"
+#include "trace.hh"
 
 #define JO_GIF_HEADER_FILE_ONLY
 #include <jo_gif.cpp>
@@ -40,8 +51,9 @@ using Palette           = std::vector<RGBA>;
 using Pattern           = std::vector<ColorIndex>;
 using PatternHash       = uint64_t; // Another representation of a Pattern.
 using PatternPrevalence = std::unordered_map<PatternHash, size_t>;
-using RandomDouble      = std::function<double()>;
+using RandomEngine      = Xoshiro256; // Any class with next_double()
 using PatternIndex      = uint16_t;
+using SupportCount      = uint16_t; // At most num_patterns, which fits in a PatternIndex.
 
 const auto kInvalidIndex = static_cast<size_t>(-1);
 const auto kInvalidHash = static_cast<PatternHash>(-1);
@@ -51,10 +63,19 @@ const size_t kGifInterval         =  16; // Save an image every X iterations
 const int    kGifDelayCentiSec    =   1;
 const int    kGifEndPauseCentiSec = 200;
 const size_t kUpscale             =   4; // Upscale images before saving
+const size_t kMaxAttempts         =  10; // Seeds to try per output image
 
 struct Options
 {
-	bool export_gif = false;
+	bool        export_gif = false;
+	size_t      num_jobs   = 1; // How many jobs and screenshots to run at the same time.
+	size_t      batch_size = 0; // If not zero, make this many images per job instead of its screenshots.
+	bool        bench      = false; // Measure each phase of each job, see BenchStats.
+	bool        perf       = false; // With bench: also read hardware counters, see PerfCounters.
+	bool        stats      = false; // Log the SolverCounters of each job.
+	bool        dry_run    = false; // Only build the models, and print what solving them would take.
+	bool        verify     = false; // Check the solver instead of writing images, see verify_job().
+	std::string trace_path;         // If not empty, write a timeline of the run here, see TraceScope.
 };
 
 enum class Result
@@ -64,6 +85,41 @@ enum class Result
 	kUnfinished,
 };
 
+// How to pick the next cell to observe.
+enum class Heuristic
+{
+	kWeightSum,    // Lowest sum of weights of the possible patterns, i.e. exp(entropy) in disguise.
+	kEntropy,      // Lowest Shannon entropy.
+	kMinRemaining, // Fewest possible patterns ("minimum remaining values").
+	kScanline,     // First undecided cell, row by row.
+	kRandom,       // Any undecided cell.
+};
+
+// How far back to roll after the i:th contradiction since the last checkpoint. Never further back
+// than the oldest checkpoint kept, see SolverOptions::num_checkpoints.
+enum class RestartSchedule
+{
+	kLuby,      // luby(i) checkpoints: 1, 1, 2, 1, 1, 2, 4, ...
+	kGeometric, // 2^(i - 1) checkpoints: 1, 2, 4, ...
+};
+
+enum class Propagation
+{
+	kSweep, // Rescan the whole output for changed cells until nothing changes.
+	kQueue, // AC-4: a worklist of bans plus a support counter per cell, pattern and direction.
+};
+
+// How run() searches, read from each job by read_solver_options().
+struct SolverOptions
+{
+	size_t          limit               = 0;   // Max observations, or 0 for no limit.
+	size_t          max_backtracks      = 0;   // Max observations backtrack() undoes, or 0 for none.
+	size_t          max_rollbacks       = 0;   // Max rollbacks to a checkpoint, or 0 for none.
+	size_t          checkpoint_interval = 100; // Observations between checkpoints.
+	size_t          num_checkpoints     = 4;   // How many of the most recent checkpoints to keep.
+	RestartSchedule restart_schedule    = RestartSchedule::kLuby;
+};
+
 const size_t MAX_COLORS = 1 << (sizeof(ColorIndex) * 8);
 
 using Graphics = Array2D<std::vector<ColorIndex>>;
@@ -80,14 +136,101 @@ struct PalettedImage
 	}
 };
 
+// A pattern that was removed from a cell, but whose consequences are not propagated yet.
+struct Ban
+{
+	int          x, y;
+	PatternIndex t;
+};
+
+// A pattern picked by observe(). Undoing it means rewinding Output::_trail to trail_size.
+struct Decision
+{
+	size_t       trail_size;
+	int          x, y;
+	PatternIndex t;
+};
+
+// Summary of the patterns still possible in one cell, kept up to date as patterns are banned.
+struct CellEntropy
+{
+	size_t num_possible;
+	double sum_of_weights;
+	double sum_of_weight_log_weights;
+	double entropy; // Shannon entropy: log(sum_of_weights) - sum_of_weight_log_weights / sum_of_weights
+};
+
+// Built with WFC_STATS=0, the WFC_COUNT() calls in the solver compile to nothing.
+#ifndef WFC_STATS
+	#define WFC_STATS 1
+#endif
+
+// How much work the solver did, printed with --stats.
+// Kept in Output, so attempts on different threads never share counters.
+struct SolverCounters
+{
+	size_t observations    = 0;
+	size_t propagate_calls = 0;
+	size_t cells_visited   = 0; // Neighbor cells looked at by propagation.
+	size_t patterns_banned = 0;
+	size_t entries_scanned = 0; // Overlapping models: propagator entries looked at.
+	size_t support_checks  = 0; // Tiled models: supports decremented, or cells checked for one.
+	size_t contradictions  = 0; // Including the ones backtracking or rolling back got us out of.
+	size_t backtracks      = 0;
+	size_t rollbacks       = 0;
+	size_t restarts        = 0; // Attempts given up on, to start over with a new seed.
+
+	SolverCounters& operator+=(const SolverCounters& other)
+	{
+		observations    += other.observations;
+		propagate_calls += other.propagate_calls;
+		cells_visited   += other.cells_visited;
+		patterns_banned += other.patterns_banned;
+		entries_scanned += other.entries_scanned;
+		support_checks  += other.support_checks;
+		contradictions  += other.contradictions;
+		backtracks      += other.backtracks;
+		rollbacks       += other.rollbacks;
+		restarts        += other.restarts;
+		return *this;
+	}
+};
+
+#if WFC_STATS
+	#define WFC_COUNT(output, counter, n) ((output)->_counters.counter += (n))
+#else
+	#define WFC_COUNT(output, counter, n) ((void)sizeof(n))
+#endif
+
 // What actually changes
 struct Output
 {
-	// _width X _height X num_patterns
+	// _width X _height X num_patterns, one bit per pattern.
 	// _wave.get(x, y, t) == is the pattern t possible at x, y?
 	// Starts off true everywhere.
-	Array3D<Bool> _wave;
+	BitArray3D    _wave;
 	Array2D<Bool> _changes; // _width X _height. Starts off false everywhere.
+	Array2D<CellEntropy> _entropy; // _width X _height. Always matches _wave.
+	bool _contradiction = false; // Has some cell run out of possible patterns?
+
+	// Every undecided cell x * _height + y, keyed by Model::selection_key(). Built by run().
+	IndexedMinHeap      _heap;
+	std::vector<double> _noise; // _width * _height. Random number in [0, 1) of each cell, drawn once.
+
+	// Only used with Propagation::kQueue:
+	// (_width * _height) X num_patterns X num_directions
+	// _compatible.get(x * _height + y, t, d) == how many patterns are still possible at the
+	// neighbor which is in direction d from x, y, and which allow pattern t at x, y.
+	Array3D<SupportCount> _compatible;
+	std::vector<Ban>      _stack; // Bans not yet propagated.
+
+	// Only used when backtracking. The trail can grow to a Ban per cell and pattern, which may be
+	// more than the rest of the Output (see ModelReport::trail_bytes), and checkpoints copy it too.
+	bool                  _record_trail = false;
+	std::vector<Ban>      _trail;     // Every ban since run() started, in order.
+	std::vector<Decision> _decisions; // Every observation which is not undone yet, in order.
+
+	SolverCounters _counters; // Of the current attempt. Survives rolling back to a checkpoint.
 };
 
 using Image = Array2D<RGBA>;
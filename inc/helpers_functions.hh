@@ -9,6 +9,11 @@ double calc_sum(const std::vector<double>& a);
 // Pick a random index weighted by a
 size_t spin_the_bottle(const std::vector<double>& a, double between_zero_and_one);
 
+// Pick a random set bit of possible, weighted by weights. sum is the total weight of the set bits.
+// Only visits the set bits and allocates nothing.
+size_t spin_the_bottle(const Word* possible, size_t num_words, const std::vector<double>& weights,
+                       double sum, double between_zero_and_one);
+
 PatternHash hash_from_pattern(const Pattern& pattern, size_t palette_size);
 
 Pattern pattern_from_hash(const PatternHash hash, int n, size_t palette_size);
@@ -26,4 +31,18 @@ Image scroll_diagonally(const Image& image);
 
 const char* result2str(const Result result);
 
+Propagation str2propagation(const std::string& str);
+
+const char* heuristic2str(const Heuristic heuristic);
+
+Heuristic str2heuristic(const std::string& str);
+
+RestartSchedule str2restart_schedule(const std::string& str);
+
+// The i:th (1-based) element of the Luby sequence: 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, 1, 1, 2, 4, 8, ...
+size_t luby(size_t i);
+
+// E.g. "12.3 MB".
+std::string bytes2str(double bytes);
+
 #endif /* HELPERS_FUNCTIONS_HH */
@@ -0,0 +1,112 @@
+#ifndef INDEXED_HEAP_HPP
+#define INDEXED_HEAP_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+const uint32_t kNotInHeap = static_cast<uint32_t>(-1);
+
+// A binary min-heap over the items 0 .. num_items - 1, each with a key.
+// Keeps track of where every item is, so the key of any item can be changed in O(log n).
+struct IndexedMinHeap
+{
+public:
+	IndexedMinHeap() {}
+	explicit IndexedMinHeap(size_t num_items) : _positions(num_items, kNotInHeap) {}
+
+	inline bool   empty() const { return _nodes.empty(); }
+	inline size_t size()  const { return _nodes.size();  }
+
+	// Memory used when every item is in the heap.
+	static size_t bytes_per_item() { return sizeof(Node) + sizeof(uint32_t); }
+
+	inline bool contains(size_t item) const { return item < _positions.size() && _positions[item] != kNotInHeap; }
+
+	inline size_t top() const { DCHECK_F(!empty()); return _nodes[0].item; }
+
+	void push(size_t item, double key)
+	{
+		DCHECK_F(!contains(item));
+		_positions[item] = _nodes.size();
+		_nodes.push_back(Node{key, static_cast<uint32_t>(item)});
+		sift_up(_nodes.size() - 1);
+	}
+
+	void update(size_t item, double key)
+	{
+		DCHECK_F(contains(item));
+		const size_t pos = _positions[item];
+		const double old_key = _nodes[pos].key;
+		_nodes[pos].key = key;
+		if (key < old_key) { sift_up(pos); }
+		else               { sift_down(pos); }
+	}
+
+	void remove(size_t item)
+	{
+		DCHECK_F(contains(item));
+		const size_t pos = _positions[item];
+		_positions[item] = kNotInHeap;
+		const Node last = _nodes.back();
+		_nodes.pop_back();
+		if (pos < _nodes.size()) {
+			const double old_key = _nodes[pos].key;
+			place(pos, last);
+			if (last.key < old_key) { sift_up(pos); }
+			else                    { sift_down(pos); }
+		}
+	}
+
+	// Empty, for items 0 .. num_items - 1. Reuses the memory we already have.
+	void reset(size_t num_items)
+	{
+		_nodes.clear();
+		_positions.assign(num_items, kNotInHeap);
+	}
+
+private:
+	struct Node
+	{
+		double   key;
+		uint32_t item;
+	};
+
+	inline void place(size_t pos, const Node& node)
+	{
+		_nodes[pos] = node;
+		_positions[node.item] = pos;
+	}
+
+	void sift_up(size_t pos)
+	{
+		const Node node = _nodes[pos];
+		while (pos > 0) {
+			const size_t parent = (pos - 1) / 2;
+			if (!(node.key < _nodes[parent].key)) { break; }
+			place(pos, _nodes[parent]);
+			pos = parent;
+		}
+		place(pos, node);
+	}
+
+	void sift_down(size_t pos)
+	{
+		const Node node = _nodes[pos];
+		for (;;) {
+			size_t child = 2 * pos + 1;
+			if (child >= _nodes.size()) { break; }
+			if (child + 1 < _nodes.size() && _nodes[child + 1].key < _nodes[child].key) { child += 1; }
+			if (!(_nodes[child].key < node.key)) { break; }
+			place(pos, _nodes[child]);
+			pos = child;
+		}
+		place(pos, node);
+	}
+
+	std::vector<Node>     _nodes;     // The heap itself.
+	std::vector<uint32_t> _positions; // num_items. Where each item is in _nodes, or kNotInHeap.
+};
+
+#endif /* INDEXED_HEAP_HPP */
@@ -4,6 +4,32 @@
 #include "definitions.hh"
 #include "helpers_functions.hh"
 
+// How big a model is, and what solving it at its _width X _height takes, before we try.
+// Logged by make_overlapping() and make_tiled(), and printed by --dry-run.
+struct ModelReport
+{
+	size_t num_patterns       = 0;
+	size_t num_directions     = 0;
+	size_t propagator_entries = 0; // Compatible (t1, d, t2), over every pattern and direction.
+	size_t propagator_bytes   = 0;
+	size_t wave_bytes         = 0; // Of one Output.
+	size_t output_bytes       = 0; // Of one Output, wave included: one attempt, or one checkpoint.
+	size_t trail_bytes        = 0; // Most that backtracking adds to one Output, see Output::_trail.
+
+	// Fraction of all (t1, d, t2) which are compatible.
+	double density() const
+	{
+		return double(propagator_entries) / std::max<size_t>(num_patterns * num_patterns * num_directions, 1);
+	}
+
+	// Propagator entries scanned (or tile supports checked) when one cell goes from every pattern
+	// to one: what an observation costs with queue propagation, before its bans spread.
+	double cost_per_observation() const
+	{
+		return double(propagator_entries) * (num_patterns - 1) / std::max<size_t>(num_patterns, 1);
+	}
+};
+
 class Model
 {
 public:
@@ -12,13 +38,43 @@ public:
 	size_t              _num_patterns;
 	bool                _periodic_out;
 	size_t              _foundation = kInvalidIndex; // Index of pattern which is at the base, or kInvalidIndex
+	Propagation         _propagation = Propagation::kQueue;
+	Heuristic           _heuristic   = Heuristic::kWeightSum;
 
 	// The weight of each pattern (e.g. how often that pattern occurs in the sample image).
 	std::vector<double> _pattern_weight; // num_patterns
+	std::vector<double> _weight_log_weight; // num_patterns, w * log(w) of each weight above
+
+	// num_patterns X num_directions. Starting value of Output::_compatible for every cell.
+	// Only used with Propagation::kQueue.
+	Array2D<SupportCount> _initial_compatible;
+
+	// What every attempt starts from: create_output() of this model, including the foundation.
+	// Made once by make_overlapping() / make_tiled(), copied by reset_output().
+	Output              _initial_output;
+
+	// The undecided cell with the lowest key is observed next.
+	// noise is a random number in [0, 1), drawn once per cell, used to break ties.
+	double selection_key(const CellEntropy& cell, int x, int y, double noise) const;
+
+	// Remove pattern t from x, y. The next call to propagate() will take care of the consequences.
+	void ban(Output* output, int x, int y, size_t t) const;
+
+	// Undo a ban, which must be the last one in output->_trail not yet undone, and propagated.
+	void unban(Output* output, const Ban& banned) const;
 
 	virtual bool propagate(Output* output) const = 0;
+	// Give back the support the propagated ban took from its neighbors. Only for Propagation::kQueue.
+	virtual void restore_support(Output* output, const Ban& banned) const = 0;
 	virtual bool on_boundary(int x, int y) const = 0;
+	// Are all pairs of neighboring cells which are down to one pattern each compatible?
+	virtual bool is_consistent(const Output& output) const = 0;
 	virtual Image image(const Output& output) const = 0;
+	virtual ModelReport report() const = 0;
+
+protected:
+	// The parts of report() that do not depend on the kind of model.
+	ModelReport output_report(size_t num_directions) const;
 };
 
-#endif /* MODEL_HH */
\ No newline at end of file
+#endif /* MODEL_HH */
@@ -6,16 +6,61 @@
 
 Output create_output(const Model& model);
 
-Result observe(const Model& model, Output* output, RandomDouble& random_double);
+// Ban every pattern t at every x, y for which allowed(x, y, t) is false, then propagate once.
+void constrain(const Model& model, Output* output, const std::function<bool(int x, int y, size_t t)>& allowed);
 
-Result run(Output* output, const Model& model, size_t seed, size_t limit, jo_gif_t* gif_out);
+// Same as *output = create_output(model), but copies model._initial_output if there is one.
+// Reuses the memory of *output, so once it has been used with this model this does not allocate.
+void reset_output(const Model& model, Output* output);
 
-Result find_lowest_entropy(const Model& model, const Output& output, RandomDouble& random_double,
-                           int* argminx, int* argminy);
+// Put every undecided cell in output->_heap, each with its own tie-breaking noise.
+void init_heap(const Model& model, Output* output, RandomEngine& rng);
 
+Result observe(const Model& model, Output* output, RandomEngine& rng);
 
-std::unique_ptr<Model> make_overlapping(const std::string& image_dir, const configuru::Config& config);
+// Call model.propagate() until it is done. Counts the calls in current_bench(), if any.
+void propagate_all(const Model& model, Output* output);
 
-std::unique_ptr<Model> make_tiled(const std::string& image_dir, const configuru::Config& config);
+// Undo the most recent observation and ban the pattern it picked instead, then propagate.
+// Repeats with earlier observations while that leads to a contradiction, undoing at most max_undone.
+// Returns how many it undid. output->_contradiction is still set if that was not enough.
+size_t backtrack(const Model& model, Output* output, size_t max_undone);
+
+// Names the attempt this thread runs, e.g. "knot #1, attempt 0", to start the lines run() logs
+// with, since with --jobs, --batch or a portfolio the lines of different attempts interleave.
+// Set by whoever calls run(). Empty for no name.
+inline std::string& current_attempt_name()
+{
+	static thread_local std::string name;
+	return name;
+}
+
+// On a contradiction, first backtracks (see backtrack()), then rolls back to a checkpoint and
+// carries on with a fresh random stream, each until its budget in options runs out.
+// Returns kUnfinished as soon as *cancel (if not null) is set, e.g. by another thread.
+Result run(Output* output, const Model& model, uint64_t seed, const SolverOptions& options, jo_gif_t* gif_out,
+           const std::atomic<bool>* cancel);
+
+// Seed of the given attempt at output image number index of a job, e.g. a screenshot.
+inline uint64_t attempt_seed(uint64_t job_seed, size_t index, size_t attempt)
+{
+	return substream_seed(substream_seed(job_seed, index), attempt);
+}
+
+Result find_lowest_entropy(const Model& model, const Output& output, int* argminx, int* argminy);
+
+
+SolverOptions read_solver_options(const configuru::Config& config);
+
+// One line with model.report(), so we know what a job will cost before it starts.
+void log_report(const Model& model);
+
+// Both log the report of the model they make. With build_initial_output = false (--dry-run) they
+// skip Model::_initial_output, which takes as much memory as an attempt.
+std::unique_ptr<Model> make_overlapping(const std::string& image_dir, const configuru::Config& config,
+                                        bool build_initial_output = true);
+
+std::unique_ptr<Model> make_tiled(const std::string& image_dir, const configuru::Config& config,
+                                  bool build_initial_output = true);
 
 #endif /* MODEL_FUNCTIONS_HH */
\ No newline at end of file
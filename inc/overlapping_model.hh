@@ -13,26 +13,76 @@ public:
 		bool                     periodic_out,
 		size_t                   width,
 		size_t                   height,
-		PatternHash              foundation_pattern);
+		PatternHash              foundation_pattern,
+		Propagation              propagation,
+		bool                     orthogonal_propagation,
+		const std::string&       propagator_cache);
 
 	bool propagate(Output* output) const override;
+	void restore_support(Output* output, const Ban& banned) const override;
 
 	bool on_boundary(int x, int y) const override
 	{
 		return !_periodic_out && (x + _n > _width || y + _n > _height);
 	}
 
+	bool is_consistent(const Output& output) const override;
+
 	Image image(const Output& output) const override;
+	ModelReport report() const override;
 
 	Graphics graphics(const Output& output) const;
 
 private:
+	bool propagate_sweep(Output* output) const;
+	bool propagate_queue(Output* output) const;
+
+	// Do the patterns overlap without contradiction when t2 is placed at (dx, dy) from t1?
+	bool agrees(size_t t1, size_t t2, int dx, int dy) const;
+
+	// The patterns which agree with pattern t when placed at _offsets[d] from it.
+	ListArray<PatternIndex>::Range propagator(size_t t, size_t d) const
+	{
+		return _propagator.list(t * _offsets.size() + d);
+	}
+
+	// The cell at _offsets[d] from x, y, wrapped around if periodic. False if there is none.
+	bool neighbor(int x, int y, size_t d, int* sx, int* sy) const
+	{
+		*sx = x + _offsets[d][0];
+		*sy = y + _offsets[d][1];
+
+		if (_periodic_out) {
+			if      (*sx <  0)      { *sx += _width; }
+			else if (*sx >= _width) { *sx -= _width; }
+
+			if      (*sy <  0)       { *sy += _height; }
+			else if (*sy >= _height) { *sy -= _height; }
+			return true;
+		} else {
+			return *sx >= 0 && *sy >= 0 && !on_boundary(*sx, *sy);
+		}
+	}
+
+	// _offsets is point symmetric, so -_offsets[d] == _offsets[opposite_direction(d)].
+	size_t opposite_direction(size_t d) const { return _offsets.size() - 1 - d; }
+
+	// Is t2 in propagator(t, d) exactly when t is in propagator(t2, opposite_direction(d))?
+	bool propagator_is_symmetric() const;
+	bool load_propagator(const std::string& path, const std::vector<PatternHash>& hashes);
+	void save_propagator(const std::string& path, const std::vector<PatternHash>& hashes) const;
+
 	int                       _n;
-	// num_patterns X (2 * n - 1) X (2 * n - 1) X ???
-	// list of other pattern indices that agree on this x/y offset (?)
-	Array3D<std::vector<PatternIndex>> _propagator;
+	// The directions (dx, dy) along which patterns constrain each other: every offset at which two
+	// patterns overlap, or only the four orthogonal ones. Agreement across the four orthogonal
+	// offsets implies agreement across all of them once every cell is decided.
+	std::vector<std::array<int, 2>> _offsets;
+	// num_patterns X num_directions lists, see propagator().
+	ListArray<PatternIndex>   _propagator;
 	std::vector<Pattern>               _patterns;
 	Palette                            _palette;
 };
 
+Image image_from_graphics(const Graphics& graphics, const Palette& palette);
+
 #endif /* OVERLAPPINGMODEL_HH */
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef PERF_COUNTERS_HH
+#define PERF_COUNTERS_HH
+
+#include <cstddef>
+#include <cstdint>
+
+// Hardware events counted by PerfCounters.
+enum class PerfEvent
+{
+	kCycles,
+	kInstructions,
+	kCacheMisses,
+	kBranchMisses,
+};
+
+const size_t kNumPerfEvents = 4;
+
+const char* perf_event2str(PerfEvent event);
+
+// Hardware performance counters of the calling thread, read with perf_event_open on Linux.
+// They are often unavailable: on other systems, in containers and VMs, or when
+// /proc/sys/kernel/perf_event_paranoid says no. Then ok() is false, and --perf falls back to
+// measuring wall time only.
+class PerfCounters
+{
+public:
+	// Starts counting.
+	PerfCounters();
+	~PerfCounters();
+
+	bool ok() const { return _group_fd >= 0; }
+
+	// Counts since construction, indexed by PerfEvent. False on failure.
+	bool read(uint64_t values[kNumPerfEvents]) const;
+
+	// What a read() adds to the counts of the code around it, since the syscall is counted too:
+	// the least counted between two back-to-back reads, measured by the constructor.
+	const uint64_t* read_cost() const { return _read_cost; }
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+private:
+	int      _group_fd = -1;
+	int      _fds[kNumPerfEvents];
+	uint64_t _read_cost[kNumPerfEvents] = {};
+};
+
+#endif /* PERF_COUNTERS_HH */
@@ -0,0 +1,72 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Advances state and returns the next splitmix64 output. Used for seeding and for deriving seeds.
+inline uint64_t splitmix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Seed of sub-stream `index` of the stream seeded with `seed`.
+// Depends on nothing but its arguments, so it does not matter which thread asks, or in what order.
+inline uint64_t substream_seed(uint64_t seed, uint64_t index)
+{
+	uint64_t state = seed ^ splitmix64(&index);
+	return splitmix64(&state);
+}
+
+// FNV-1a, to turn e.g. a job name into a seed.
+inline uint64_t seed_from_string(const std::string& str)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char c : str) {
+		hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// xoshiro256** (Blackman & Vigna): 32 bytes of state, fast, and small enough to inline.
+class Xoshiro256
+{
+public:
+	explicit Xoshiro256(uint64_t seed)
+	{
+		for (auto& s : _s) {
+			s = splitmix64(&seed);
+		}
+	}
+
+	inline uint64_t next_u64()
+	{
+		const uint64_t result = rotl(_s[1] * 5, 7) * 9;
+		const uint64_t t = _s[1] << 17;
+		_s[2] ^= _s[0];
+		_s[3] ^= _s[1];
+		_s[1] ^= _s[2];
+		_s[0] ^= _s[3];
+		_s[2] ^= t;
+		_s[3] = rotl(_s[3], 45);
+		return result;
+	}
+
+	// Uniform in [0, 1), using the top 53 bits.
+	inline double next_double()
+	{
+		return (next_u64() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+private:
+	static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	uint64_t _s[4];
+};
+
+#endif /* RANDOM_HPP */
@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own queue of tasks.
+// A worker takes the newest task from its own queue, and when that is empty steals the oldest
+// task from another worker, so tasks pushed by a long task get spread over the idle workers.
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	explicit ThreadPool(size_t num_threads);
+	// Waits for all tasks to finish.
+	~ThreadPool();
+
+	// Called from one of our workers, the task goes on the queue of that worker.
+	void push(Task task);
+
+	// Block until every task, including the ones pushed by other tasks, has finished.
+	void wait();
+
+private:
+	struct Queue
+	{
+		std::mutex       mutex;
+		std::deque<Task> tasks;
+	};
+
+	void work(size_t index);
+	bool pop(size_t index, Task* out_task);
+
+	std::vector<std::unique_ptr<Queue>> _queues; // One per worker.
+	std::vector<std::thread>            _threads;
+
+	std::mutex              _mutex; // Protects the members below.
+	std::condition_variable _wake;  // Signaled when a task is pushed, or when stopping.
+	std::condition_variable _idle;  // Signaled when _num_pending reaches zero.
+	size_t                  _num_queued  = 0; // Pushed, not yet taken by a worker (counted a little early).
+	size_t                  _num_pending = 0; // Pushed, not yet finished.
+	size_t                  _next_queue  = 0; // Where tasks from outside the pool go, round robin.
+	bool                    _stop        = false;
+};
+
+#endif /* THREAD_POOL_HH */
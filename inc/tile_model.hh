@@ -9,19 +9,55 @@ using TileLoader = std::function<Tile(const std::string& tile_name)>;
 class TileModel : public Model
 {
 public:
-	TileModel(const configuru::Config& config, std::string subset_name, int width, int height, bool periodic, const TileLoader& tile_loader);
+	TileModel(const configuru::Config& config, std::string subset_name, int width, int height, bool periodic,
+	          Propagation propagation, const TileLoader& tile_loader);
 
 	bool propagate(Output* output) const override;
+	void restore_support(Output* output, const Ban& banned) const override;
 
 	bool on_boundary(int x, int y) const override
 	{
 		return false;
 	}
 
+	bool is_consistent(const Output& output) const override;
+
 	Image image(const Output& output) const override;
+	ModelReport report() const override;
 
 private:
-	Array3D<Bool>                  _propagator; // 4 X _num_patterns X _num_patterns
+	bool propagate_sweep(Output* output) const;
+	bool propagate_queue(Output* output) const;
+
+	// The neighbor which sees x, y in direction d (see propagate_sweep), wrapped around if periodic.
+	// False if there is none.
+	bool neighbor(int x, int y, int d, int* x2, int* y2) const
+	{
+		*x2 = x;
+		*y2 = y;
+		if      (d == 0) { *x2 += 1; }
+		else if (d == 1) { *y2 -= 1; }
+		else if (d == 2) { *x2 -= 1; }
+		else             { *y2 += 1; }
+
+		if (*x2 < 0 || *x2 >= _width || *y2 < 0 || *y2 >= _height) {
+			if (!_periodic_out) { return false; }
+			*x2 = (*x2 + _width)  % _width;
+			*y2 = (*y2 + _height) % _height;
+		}
+		return true;
+	}
+
+	// Every t2 for which _propagator.get(d, t1, t2), in order. Only used with Propagation::kQueue.
+	ListArray<PatternIndex>::Range agrees(int d, size_t t1) const
+	{
+		return _agrees.list(d * _num_patterns + t1);
+	}
+
+	// 4 X _num_patterns. _propagator.words(d, t1) is the set of patterns t2 that may follow t1 in
+	// direction d. Direction d + 2 (mod 4) is the transpose of d.
+	BitArray3D                     _propagator;
+	ListArray<PatternIndex>        _agrees; // See agrees().
 	std::vector<std::vector<RGBA>> _tiles;
 	size_t                         _tile_size;
 };
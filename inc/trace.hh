@@ -0,0 +1,71 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <cstdint>
+#include <string>
+
+// A timeline of what each thread did, written by --trace in the Chrome trace event format, for
+// Perfetto or about:tracing. Each thread records to its own buffer, so recording takes no lock.
+
+// Set once, before any thread starts recording. Off by default, when a TraceScope costs one branch.
+inline bool& trace_enabled()
+{
+	static bool enabled = false;
+	return enabled;
+}
+
+// Time since the trace started, which is when the program started.
+int64_t trace_now_ns();
+
+// Phases run many times per attempt, so a long run records millions of them and they are capped.
+// Scopes around them (job, model, attempt, ...) are few, and always kept.
+enum class TraceKind
+{
+	kScope,
+	kPhase,
+};
+
+// Add an event to the buffer of this thread. args is the inside of a JSON object, or empty.
+void record_trace_event(TraceKind kind, const char* name, int64_t begin_ns, int64_t end_ns, std::string args);
+
+// str as a quoted JSON string, for putting names into args.
+std::string json_string(const std::string& str);
+
+// Every event recorded so far, as one JSON file. Call when no thread is recording.
+// Returns false on failure.
+bool write_trace_json(const std::string& path);
+
+// Records an event from construction until it goes out of scope.
+class TraceScope
+{
+public:
+	// name must outlive the trace, e.g. a string literal.
+	explicit TraceScope(const char* name, TraceKind kind = TraceKind::kScope) : _kind(kind), _name(name)
+	{
+		if (trace_enabled()) {
+			_begin_ns = trace_now_ns();
+		}
+	}
+
+	~TraceScope()
+	{
+		if (trace_enabled()) {
+			record_trace_event(_kind, _name, _begin_ns, trace_now_ns(), std::move(_args));
+		}
+	}
+
+	// Details shown with the event, e.g. "\"job\": " + json_string(name).
+	// Only worth formatting if trace_enabled().
+	void set_args(std::string args) { _args = std::move(args); }
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	TraceKind   _kind;
+	const char* _name;
+	int64_t     _begin_ns = 0;
+	std::string _args;
+};
+
+#endif /* TRACE_HH */
@@ -0,0 +1,77 @@
+#include "alloc_tracker.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+	#include <malloc.h>
+#elif defined(__APPLE__)
+	#include <malloc/malloc.h>
+#endif
+
+#include "bench.hh"
+
+static std::atomic<size_t>  s_num_allocations{0};
+static std::atomic<size_t>  s_num_bytes_allocated{0};
+static std::atomic<int64_t> s_num_live_bytes{0};
+
+size_t  num_allocations()     { return s_num_allocations.load(std::memory_order_relaxed); }
+size_t  num_bytes_allocated() { return s_num_bytes_allocated.load(std::memory_order_relaxed); }
+int64_t num_live_bytes()      { return s_num_live_bytes.load(std::memory_order_relaxed); }
+
+// What free() will give back for ptr. Zero where the allocator cannot tell, so live bytes are not counted.
+static int64_t usable_size(void* ptr)
+{
+#if defined(__GLIBC__)
+	return malloc_usable_size(ptr);
+#elif defined(__APPLE__)
+	return malloc_size(ptr);
+#else
+	return 0;
+#endif
+}
+
+static void note_allocation(void* ptr, size_t size)
+{
+	s_num_allocations.fetch_add(1, std::memory_order_relaxed);
+	s_num_bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+	// Count what free() will give back, so memory allocated and freed adds up to zero:
+	const int64_t usable = usable_size(ptr);
+	const int64_t live   = s_num_live_bytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+
+	if (BenchStats* bench = current_bench()) {
+		const size_t phase = bench->active_phase >= 0 ? bench->active_phase : kNumPhases;
+		bench->num_allocations[phase] += 1;
+		bench->bytes_allocated[phase] += size;
+		bench->peak_live_bytes = std::max(bench->peak_live_bytes, live);
+	}
+}
+
+// Not inlined, or GCC warns about new/free mismatches, not knowing that we replaced new.
+__attribute__((noinline)) static void deallocate(void* ptr)
+{
+	if (ptr && alloc_tracking_enabled()) {
+		s_num_live_bytes.fetch_sub(usable_size(ptr), std::memory_order_relaxed);
+	}
+	std::free(ptr);
+}
+
+void* operator new(size_t size)
+{
+	void* ptr = std::malloc(size == 0 ? 1 : size);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	if (alloc_tracking_enabled()) {
+		note_allocation(ptr, size);
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { deallocate(ptr); }
@@ -0,0 +1,60 @@
+#include "batch.hh"
+
+BatchStats run_batch(const Model& model, uint64_t job_seed, const SolverOptions& solver, size_t num_outputs,
+                     size_t num_threads, const BatchWriter& writer)
+{
+	std::atomic<size_t> next_index{0};
+	std::atomic<size_t> num_succeeded{0};
+	std::atomic<size_t> num_attempts{0};
+	std::atomic<size_t> num_contradictions{0};
+	SolverCounters counters;
+	std::mutex     counters_mutex;
+	const auto start_time = std::chrono::steady_clock::now();
+
+	const auto work = [&]() {
+		Output output; // Reused by every attempt of this thread.
+		SolverCounters thread_counters;
+		for (size_t i = next_index++; i < num_outputs; i = next_index++) {
+			for (const auto attempt : irange(kMaxAttempts)) {
+				TraceScope trace("attempt");
+				reset_output(model, &output);
+				current_attempt_name() = emilib::strprintf("output %lu, attempt %lu", i, attempt);
+				const auto result = run(&output, model, attempt_seed(job_seed, i, attempt), solver, nullptr, nullptr);
+				current_attempt_name().clear();
+				if (trace_enabled()) {
+					trace.set_args(emilib::strprintf("\"output\": %lu, \"attempt\": %lu, \"result\": \"%s\"",
+					                                 i, attempt, result2str(result)));
+				}
+				num_attempts += 1;
+				num_contradictions += result == Result::kFail;
+				thread_counters += output._counters;
+
+				if (result == Result::kSuccess) {
+					writer(i, output);
+					num_succeeded += 1;
+					break;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(counters_mutex);
+		counters += thread_counters;
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < num_threads; ++t) {
+		threads.emplace_back(work);
+	}
+	work();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	BatchStats stats;
+	stats.num_outputs        = num_succeeded;
+	stats.num_attempts       = num_attempts;
+	stats.num_contradictions = num_contradictions;
+	stats.counters           = counters;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	return stats;
+}
@@ -0,0 +1,105 @@
+#include "bench.hh"
+
+#include "alloc_tracker.hh"
+
+#include <algorithm>
+#include <cstdio>
+
+const char* phase2str(Phase phase)
+{
+	switch (phase) {
+		case Phase::kImageLoad:         return "image_load";
+		case Phase::kPatternExtraction: return "pattern_extraction";
+		case Phase::kPropagatorBuild:   return "propagator_build";
+		case Phase::kObserve:           return "observe";
+		case Phase::kPropagate:         return "propagate";
+		case Phase::kRender:            return "render";
+		case Phase::kEncode:            return "encode";
+	}
+	return "unknown";
+}
+
+void switch_phase(BenchStats* stats, int phase)
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (stats->active_phase >= 0) {
+		stats->seconds[stats->active_phase] += std::chrono::duration<double>(now - stats->active_since).count();
+	}
+	stats->active_since = now;
+
+	uint64_t perf_now[kNumPerfEvents];
+	if (stats->perf && stats->perf->read(perf_now)) {
+		if (stats->active_phase >= 0) {
+			const uint64_t* read_cost = stats->perf->read_cost();
+			for (size_t i = 0; i < kNumPerfEvents; ++i) {
+				const uint64_t counted = perf_now[i] - stats->perf_since[i];
+				stats->perf_counts[stats->active_phase][i] += counted > read_cost[i] ? counted - read_cost[i] : 0;
+			}
+		}
+		std::copy(perf_now, perf_now + kNumPerfEvents, stats->perf_since);
+		stats->num_perf_reads += 1;
+	}
+
+	stats->active_phase = phase;
+}
+
+bool write_bench_json(const std::string& path, const std::string& job_name, const BenchStats& stats)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) { return false; }
+
+	double other_seconds = stats.total_seconds;
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"job\": \"%s\",\n", job_name.c_str());
+	fprintf(file, "\t\"seconds\": {\n");
+	for (size_t i = 0; i < kNumPhases; ++i) {
+		fprintf(file, "\t\t\"%s\": %.6f,\n", phase2str(static_cast<Phase>(i)), stats.seconds[i]);
+		other_seconds -= stats.seconds[i];
+	}
+	fprintf(file, "\t\t\"other\": %.6f\n", std::max(other_seconds, 0.0));
+	fprintf(file, "\t},\n");
+
+	if (alloc_tracking_enabled()) {
+		const auto write_per_phase = [&](const char* key, const size_t* values) {
+			fprintf(file, "\t\"%s\": {\n", key);
+			for (size_t i = 0; i < kNumPhases; ++i) {
+				fprintf(file, "\t\t\"%s\": %lu,\n", phase2str(static_cast<Phase>(i)), values[i]);
+			}
+			fprintf(file, "\t\t\"other\": %lu\n", values[kNumPhases]);
+			fprintf(file, "\t},\n");
+		};
+		write_per_phase("allocations", stats.num_allocations);
+		write_per_phase("bytes_allocated", stats.bytes_allocated);
+		fprintf(file, "\t\"peak_live_bytes\": %ld,\n", stats.peak_live_bytes);
+	}
+
+	if (stats.perf) {
+		const auto write_counts = [&](const char* key, const uint64_t* counts, const char* separator) {
+			fprintf(file, "\t\t\"%s\": {", key);
+			for (size_t i = 0; i < kNumPerfEvents; ++i) {
+				fprintf(file, "%s\"%s\": %lu", i == 0 ? "" : ", ", perf_event2str(static_cast<PerfEvent>(i)),
+				        counts[i]);
+			}
+			fprintf(file, "}%s\n", separator);
+		};
+		fprintf(file, "\t\"perf\": {\n");
+		for (size_t i = 0; i < kNumPhases; ++i) {
+			write_counts(phase2str(static_cast<Phase>(i)), stats.perf_counts[i], ",");
+		}
+		write_counts("total", stats.perf_total, ",");
+		write_counts("read_cost", stats.perf->read_cost(), ",");
+		fprintf(file, "\t\t\"reads\": %lu\n", stats.num_perf_reads);
+		fprintf(file, "\t},\n");
+	}
+
+	fprintf(file, "\t\"total_seconds\": %.6f,\n", stats.total_seconds);
+	fprintf(file, "\t\"attempts\": %lu,\n",   stats.num_attempts);
+	fprintf(file, "\t\"successes\": %lu,\n",  stats.num_successes);
+	fprintf(file, "\t\"iterations\": %lu,\n", stats.num_iterations);
+	fprintf(file, "\t\"propagate_calls\": %lu,\n", stats.num_propagate_calls);
+	fprintf(file, "\t\"backtracks\": %lu,\n", stats.num_backtracks);
+	fprintf(file, "\t\"rollbacks\": %lu\n",   stats.num_rollbacks);
+	fprintf(file, "}\n");
+
+	return fclose(file) == 0;
+}
@@ -28,6 +28,27 @@ size_t spin_the_bottle(const std::vector<double>& a, double between_zero_and_one
 	return 0;
 }
 
+size_t spin_the_bottle(const Word* possible, size_t num_words, const std::vector<double>& weights,
+                       double sum, double between_zero_and_one)
+{
+	const double between_zero_and_sum = between_zero_and_one * sum;
+
+	double accumulated = 0;
+	size_t last = kInvalidIndex;
+
+	for (size_t i = 0; i < num_words; ++i) {
+		for (Word word = possible[i]; word != 0; word &= word - 1) {
+			last = i * kBitsPerWord + __builtin_ctzll(word);
+			accumulated += weights[last];
+			if (between_zero_and_sum <= accumulated) {
+				return last;
+			}
+		}
+	}
+
+	return last; // sum was a little too large because of rounding errors.
+}
+
 PatternHash hash_from_pattern(const Pattern& pattern, size_t palette_size)
 {
 	CHECK_LT_F(std::pow((double)palette_size, (double)pattern.size()),
@@ -186,4 +207,60 @@ const char* result2str(const Result result)
 	return result == Result::kSuccess ? "success"
 	     : result == Result::kFail    ? "fail"
 	     : "unfinished";
-}
\ No newline at end of file
+}
+
+Propagation str2propagation(const std::string& str)
+{
+	if (str == "sweep") { return Propagation::kSweep; }
+	if (str == "queue") { return Propagation::kQueue; }
+	ABORT_F("Unknown propagation '%s', expected 'sweep' or 'queue'", str.c_str());
+}
+
+const char* heuristic2str(const Heuristic heuristic)
+{
+	return heuristic == Heuristic::kWeightSum    ? "weight_sum"
+	     : heuristic == Heuristic::kEntropy      ? "entropy"
+	     : heuristic == Heuristic::kMinRemaining ? "min_remaining"
+	     : heuristic == Heuristic::kScanline     ? "scanline"
+	     : "random";
+}
+
+Heuristic str2heuristic(const std::string& str)
+{
+	for (const auto heuristic : {Heuristic::kWeightSum, Heuristic::kEntropy, Heuristic::kMinRemaining,
+	                             Heuristic::kScanline, Heuristic::kRandom}) {
+		if (str == heuristic2str(heuristic)) { return heuristic; }
+	}
+	ABORT_F("Unknown heuristic '%s', expected weight_sum, entropy, min_remaining, scanline or random", str.c_str());
+}
+
+RestartSchedule str2restart_schedule(const std::string& str)
+{
+	if (str == "luby")      { return RestartSchedule::kLuby;      }
+	if (str == "geometric") { return RestartSchedule::kGeometric; }
+	ABORT_F("Unknown restart_schedule '%s', expected 'luby' or 'geometric'", str.c_str());
+}
+
+size_t luby(size_t i)
+{
+	DCHECK_GT_F(i, 0u);
+	for (;;) {
+		size_t k = 1;
+		while ((size_t(1) << k) - 1 < i) { ++k; }
+		if ((size_t(1) << k) - 1 == i) {
+			return size_t(1) << (k - 1);
+		}
+		i -= (size_t(1) << (k - 1)) - 1;
+	}
+}
+
+std::string bytes2str(double bytes)
+{
+	const char* units[] = {"B", "kB", "MB", "GB", "TB"};
+	size_t unit = 0;
+	while (bytes >= 1000 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+		bytes /= 1000;
+		unit += 1;
+	}
+	return emilib::strprintf(unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+}
@@ -1,5 +1,10 @@
+// The failure reason is a global, which jobs running in parallel would race on. We never read it.
+#define STBI_NO_FAILURE_STRINGS 1
 #define STB_IMAGE_IMPLEMENTATION 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function" // stbi__err
 #include <stb_image.h>
+#pragma GCC diagnostic pop
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION 1
 #include <stb_image_write.h>
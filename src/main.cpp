@@ -1,51 +1,431 @@
 #include "overlapping_model.hh"
 #include "tile_model.hh"
 #include "make_pattern.hpp"
+#include "alloc_tracker.hh"
+#include "batch.hh"
 #include "model_functions.hh"
+#include "thread_pool.hh"
 
 const auto kUsage = R"(
-wfc.bin [-h/--help] [--gif] [job=samples.cfg, ...]
+wfc.bin [-h/--help] [--gif] [--jobs N] [--batch N] [--bench] [--allocs] [--perf] [--stats]
+        [--trace out.json] [--dry-run] [--verify]
+        [job=samples.cfg, ...]
 	-h/--help   Print this help
 	--gif       Export GIF images of the process
+	--jobs N    Run up to N jobs and screenshots at the same time (0 = one per core)
+	--batch N   Make N images per job instead of its screenshots, one job at a time, on every core
+	            (or on --jobs threads)
+	--bench     Run one job at a time on one thread, and write the time spent in each phase, and
+	            the number of attempts and iterations, to output/bench_<job>.json
+	--allocs    --bench, and also count the allocations and bytes allocated in each phase, and
+	            the peak of live bytes during each job
+	--perf      --bench, and also read the cycles, instructions, cache misses and branch misses of
+	            each phase from the hardware performance counters, if available (Linux only).
+	            The counters are read at every phase switch; the cost of a read is subtracted
+	--stats     Log how much work the solver did for each job: observations, propagation, restarts...
+	--trace out.json
+	            Write a timeline of every thread: model construction, screenshots, attempts, each
+	            observation and propagation, rendering and encoding. Open it in Perfetto or about:tracing
+	--verify    Solve the seeds of every screenshot with all overlap offsets and with the four
+	            orthogonal ones, check that every success is consistent, and compare the results.
+	            Writes no images
+	--dry-run   Only build the model of each job, and print its size, the memory an attempt and the
+	            whole job will need, and the cost of an observation
 	file        Jobs to run
 )";
 
-void run_and_write(const Options& options, const std::string& name, const configuru::Config& config, const Model& model)
+// Everything needed to run the screenshots of one entry in a config file.
+// Read up front, so the screenshots can run on other threads without touching the config.
+struct Job
 {
-	const size_t limit       = config.get_or("limit",       0);
-	const size_t screenshots = config.get_or("screenshots", 2);
+	std::string            name;
+	std::unique_ptr<Model> model;
+	SolverOptions          solver;
+	size_t                 screenshots;
+	// How many attempts to run at the same time, each on its own thread. The lowest-numbered
+	// success wins, not the first to finish, so the image is the one portfolio: 1 would make.
+	size_t                 portfolio;
+	// Every attempt gets its own stream, derived from the job name, screenshot and attempt only,
+	// so a job produces the same images no matter how many jobs ran before it or on which thread.
+	uint64_t               seed;
+};
 
-	for (const auto i : irange(screenshots)) {
-		for (const auto attempt : irange(10)) {
-			(void)attempt;
-			int seed = rand();
+struct ScreenshotStats
+{
+	size_t num_attempts       = 0;
+	size_t num_contradictions = 0;
+	double seconds            = 0;
+	SolverCounters counters; // Summed over every attempt.
+};
 
-			Output output = create_output(model);
+Job make_job(const std::string& name, const configuru::Config& config, std::unique_ptr<Model> model)
+{
+	Job job;
+	job.name        = name;
+	job.model       = std::move(model);
+	job.solver      = read_solver_options(config);
+	job.screenshots = config.get_or("screenshots", 2);
+	job.portfolio   = std::max(config.get_or("portfolio", 1), 1);
+	job.seed        = substream_seed(seed_from_string(name), config.get_or("seed", 0));
+	return job;
+}
+
+void write_png(const Job& job, size_t i, const Output& output)
+{
+	PhaseTimer timer(Phase::kRender);
+	const auto image = job.model->image(output);
+	PhaseTimer encode_timer(Phase::kEncode);
+	const auto out_path = emilib::strprintf("output/%s_%lu.png", job.name.c_str(), i);
+	CHECK_F(stbi_write_png(out_path.c_str(), image.width(), image.height(), 4, image.data(), 0) != 0,
+	        "Failed to write image to %s", out_path.c_str());
+}
+
+// Try up to kMaxAttempts seeds, and write the first success to output/<name>_<i>.png
+ScreenshotStats run_screenshot(const Options& options, const Job& job, size_t i)
+{
+	TraceScope trace("screenshot");
+	if (trace_enabled()) {
+		trace.set_args(emilib::strprintf("\"job\": %s, \"screenshot\": %lu", json_string(job.name).c_str(), i));
+	}
+
+	const Model& model = *job.model;
+	const bool export_gif = options.export_gif && job.portfolio == 1;
+
+	ScreenshotStats stats;
+	const auto start_time = std::chrono::steady_clock::now();
+
+	std::vector<Output> outputs(job.portfolio); // Reused by every round of attempts.
+
+	for (size_t first_attempt = 0; first_attempt < kMaxAttempts; first_attempt += job.portfolio) {
+		const size_t num_threads = std::min(job.portfolio, kMaxAttempts - first_attempt);
+		std::vector<Result> results(num_threads, Result::kUnfinished);
+		std::unique_ptr<std::atomic<bool>[]> cancel(new std::atomic<bool>[num_threads]);
+		for (const auto k : irange(num_threads)) {
+			cancel[k] = false;
+		}
+
+		const auto run_attempt = [&](size_t k) {
+			TraceScope trace("attempt");
+			const uint64_t seed = attempt_seed(job.seed, i, first_attempt + k);
+			current_attempt_name() = emilib::strprintf("%s #%lu, attempt %lu", job.name.c_str(), i, first_attempt + k);
+
+			reset_output(model, &outputs[k]);
 
 			jo_gif_t gif;
 
-			if (options.export_gif) {
-				const auto initial_image = model.image(output);
-				const auto gif_path = emilib::strprintf("output/%s_%lu.gif", name.c_str(), i);
+			if (export_gif) {
+				const auto initial_image = model.image(outputs[k]);
+				const auto gif_path = emilib::strprintf("output/%s_%lu.gif", job.name.c_str(), i);
 				const int gif_palette_size = 255; // TODO
 				gif = jo_gif_start(gif_path.c_str(), initial_image.width(), initial_image.height(), 0, gif_palette_size);
 			}
 
-			const auto result = run(&output, model, seed, limit, options.export_gif ? &gif : nullptr);
+			results[k] = run(&outputs[k], model, seed, job.solver, export_gif ? &gif : nullptr, &cancel[k]);
 
-			if (options.export_gif) {
+			if (export_gif) {
 				jo_gif_end(&gif);
 			}
 
-			if (result == Result::kSuccess) {
-				const auto image = model.image(output);
-				const auto out_path = emilib::strprintf("output/%s_%lu.png", name.c_str(), i);
-				CHECK_F(stbi_write_png(out_path.c_str(), image.width(), image.height(), 4, image.data(), 0) != 0,
-				        "Failed to write image to %s", out_path.c_str());
-				break;
+			if (trace_enabled()) {
+				trace.set_args(emilib::strprintf("\"job\": %s, \"screenshot\": %lu, \"attempt\": %lu, \"result\": \"%s\"",
+				                                 json_string(job.name).c_str(), i, first_attempt + k, result2str(results[k])));
+			}
+
+			current_attempt_name().clear();
+
+			if (results[k] == Result::kSuccess) {
+				// Later attempts cannot win any more, but earlier ones still can, so they go on.
+				for (size_t later = k + 1; later < num_threads; ++later) {
+					cancel[later] = true;
+				}
+			}
+		};
+
+		if (num_threads == 1) {
+			run_attempt(0);
+		} else {
+			std::vector<std::thread> threads;
+			for (const auto k : irange(num_threads)) {
+				threads.emplace_back(run_attempt, k);
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+		}
+
+		for (const auto k : irange(num_threads)) {
+			stats.num_attempts += 1;
+			stats.num_contradictions += results[k] == Result::kFail;
+			stats.counters += outputs[k]._counters;
+		}
+
+		const size_t winner = std::find(results.begin(), results.end(), Result::kSuccess) - results.begin();
+		if (winner < num_threads) {
+			if (job.portfolio > 1) {
+				LOG_F(INFO, "%s #%lu: attempt %lu wins", job.name.c_str(), i, first_attempt + winner);
+			}
+			write_png(job, i, outputs[winner]);
+			break;
+		}
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	return stats;
+}
+
+void log_counters(const std::string& name, const SolverCounters& counters)
+{
+	LOG_F(INFO, "%s: %lu observations, %lu propagate calls, %lu cells visited, %lu patterns banned, "
+	      "%lu propagator entries scanned, %lu support checks, %lu contradictions, %lu backtracks, "
+	      "%lu rollbacks, %lu restarts",
+	      name.c_str(), counters.observations, counters.propagate_calls, counters.cells_visited,
+	      counters.patterns_banned, counters.entries_scanned, counters.support_checks, counters.contradictions,
+	      counters.backtracks, counters.rollbacks, counters.restarts);
+}
+
+void log_stats(const Options& options, const std::string& name, Heuristic heuristic,
+               const std::vector<ScreenshotStats>& all_stats)
+{
+	ScreenshotStats total;
+	for (const auto& stats : all_stats) {
+		total.num_attempts       += stats.num_attempts;
+		total.num_contradictions += stats.num_contradictions;
+		total.seconds            += stats.seconds;
+		total.counters           += stats.counters;
+	}
+	LOG_F(INFO, "%s: heuristic %s: %lu/%lu attempts hit a contradiction (%.0f%%), %.3f s",
+	      name.c_str(), heuristic2str(heuristic), total.num_contradictions, total.num_attempts,
+	      100.0 * total.num_contradictions / total.num_attempts, total.seconds);
+	if (options.stats) {
+		log_counters(name, total.counters);
+	}
+}
+
+void run_and_write(const Options& options, const Job& job)
+{
+	if (options.export_gif && job.portfolio > 1) {
+		LOG_F(WARNING, "Not exporting GIF images: not supported with a portfolio of attempts");
+	}
+
+	std::vector<ScreenshotStats> stats;
+	for (const auto i : irange(job.screenshots)) {
+		stats.push_back(run_screenshot(options, job, i));
+	}
+	log_stats(options, job.name, job.model->_heuristic, stats);
+}
+
+// Make options.batch_size images of the job, using every thread, instead of its screenshots.
+void run_batch_and_write(const Options& options, const Job& job)
+{
+	const auto stats = run_batch(*job.model, job.seed, job.solver, options.batch_size, options.num_jobs,
+	                             [&](size_t i, const Output& output) { write_png(job, i, output); });
+	LOG_F(INFO, "%s: %lu/%lu outputs, %lu/%lu attempts hit a contradiction, %.3f s: %.2f outputs/s",
+	      job.name.c_str(), stats.num_outputs, options.batch_size, stats.num_contradictions, stats.num_attempts,
+	      stats.seconds, stats.num_outputs / stats.seconds);
+	if (options.stats) {
+		log_counters(job.name, stats.counters);
+	}
+}
+
+// One entry of a config file.
+struct JobEntry
+{
+	std::string              name;
+	const configuru::Config* config;
+	bool                     tiled;
+};
+
+std::unique_ptr<Model> make_model(const std::string& image_dir, const JobEntry& entry,
+                                  bool build_initial_output = true)
+{
+	TraceScope trace("model");
+	if (trace_enabled()) {
+		trace.set_args(emilib::strprintf("\"job\": %s, \"tiled\": %s", json_string(entry.name).c_str(),
+		                                 entry.tiled ? "true" : "false"));
+	}
+
+	if (entry.tiled) {
+		return make_tiled(image_dir, *entry.config, build_initial_output);
+	} else {
+		return make_overlapping(image_dir, *entry.config, build_initial_output);
+	}
+}
+
+// Solve the seeds of each screenshot of an overlapping job twice: propagating along every overlap
+// offset, and along the four orthogonal ones only. Aborts if any success has incompatible
+// neighbors, checked against every offset by is_consistent(), so this works in release builds.
+// Tiled jobs have only the four directions, so their successes are only checked.
+void verify_job(const std::string& image_dir, const JobEntry& entry)
+{
+	configuru::Config full_config       = *entry.config;
+	configuru::Config orthogonal_config = *entry.config;
+	full_config["orthogonal_propagation"]       = false;
+	orthogonal_config["orthogonal_propagation"] = true;
+
+	const auto job = make_job(entry.name, *entry.config, nullptr); // Only for its seeds and solver options.
+	std::vector<std::unique_ptr<Model>> models;
+	if (entry.tiled) {
+		models.push_back(make_tiled(image_dir, *entry.config));
+	} else {
+		models.push_back(make_overlapping(image_dir, full_config));
+		models.push_back(make_overlapping(image_dir, orthogonal_config));
+	}
+
+	size_t num_seeds = 0, num_same_result = 0, num_same_image = 0;
+	std::vector<size_t> num_successes(models.size(), 0);
+	Output output;
+
+	for (const auto i : irange(job.screenshots)) {
+		for (const auto attempt : irange(kMaxAttempts)) {
+			const uint64_t seed = attempt_seed(job.seed, i, attempt);
+			std::vector<Result> results;
+			std::vector<Image>  images;
+			for (const auto m : irange(models.size())) {
+				const Model& model = *models[m];
+				reset_output(model, &output);
+				results.push_back(run(&output, model, seed, job.solver, nullptr, nullptr));
+				if (results.back() == Result::kSuccess) {
+					CHECK_F(models[0]->is_consistent(output),
+					        "%s: screenshot %lu, attempt %lu: a success with incompatible neighbors",
+					        entry.name.c_str(), i, attempt);
+					num_successes[m] += 1;
+				}
+				images.push_back(model.image(output));
+			}
+
+			num_seeds += 1;
+			if (models.size() == 2) {
+				num_same_result += results[0] == results[1];
+				num_same_image  += results[0] == results[1]
+				                && memcmp(images[0].data(), images[1].data(),
+				                          images[0].width() * images[0].height() * sizeof(RGBA)) == 0;
+			}
+			if (results[0] == Result::kSuccess) { break; }
+		}
+	}
+
+	if (entry.tiled) {
+		LOG_F(INFO, "%s: %lu seeds, %lu consistent successes", entry.name.c_str(), num_seeds, num_successes[0]);
+	} else {
+		LOG_F(INFO, "%s: %lu seeds. All offsets: %lu successes, orthogonal: %lu successes, all consistent. "
+		      "Same result for %lu seeds, same image for %lu", entry.name.c_str(), num_seeds,
+		      num_successes[0], num_successes[1], num_same_result, num_same_image);
+	}
+}
+
+// Build the model of every job, without the memory of any attempt, and print a table of what
+// solving them would take. The peak of a job counts the attempts of a portfolio, their
+// checkpoints and the initial output, but not other jobs or screenshots running at the same time.
+void print_dry_run(const std::string& image_dir, const std::vector<JobEntry>& entries)
+{
+	printf("%-28s %8s %4s %8s %10s %9s %10s %10s %10s %12s\n", "job", "patterns", "dirs", "density",
+	       "propagator", "size", "wave", "attempt", "job peak", "cost/obs");
+
+	for (const auto& entry : entries) {
+		const auto job = make_job(entry.name, *entry.config, make_model(image_dir, entry, false));
+		if (!entry.tiled) {
+			entry.config->check_dangling();
+		}
+
+		const Model& model = *job.model;
+		const auto report = model.report();
+		const size_t checkpoints = job.solver.max_rollbacks > 0 ? job.solver.num_checkpoints : 0;
+		const size_t num_outputs = job.portfolio * (1 + checkpoints);
+		// Each attempt and checkpoint may hold a full trail. The template output, counted once, has none.
+		const size_t output_bytes = report.output_bytes + (job.solver.max_backtracks > 0 ? report.trail_bytes : 0);
+		const auto name = emilib::strprintf("%s%s", entry.tiled ? "tiled " : "", entry.name.c_str());
+		const auto size = emilib::strprintf("%lux%lu", model._width, model._height);
+
+		printf("%-28s %8lu %4lu %7.1f%% %10s %9s %10s %10s %10s %12.0f\n", name.c_str(), report.num_patterns,
+		       report.num_directions, 100 * report.density(), bytes2str(report.propagator_bytes).c_str(),
+		       size.c_str(), bytes2str(report.wave_bytes).c_str(), bytes2str(output_bytes).c_str(),
+		       bytes2str(report.propagator_bytes + report.output_bytes + num_outputs * output_bytes).c_str(),
+		       report.cost_per_observation());
+	}
+}
+
+// Run the jobs and their screenshots on options.num_jobs threads.
+// Each job builds its model, then pushes one task per screenshot, which idle workers steal.
+// Images go to the same files as when running one by one, and since every attempt is seeded from
+// the job name, screenshot and attempt, they are the same images. Jobs with the same name write
+// the same files, so those still run one after the other, in order. The per-job summaries are
+// logged at the end, in the order of the config file.
+void run_jobs_in_pool(const Options& options, const std::string& image_dir, const std::vector<JobEntry>& entries)
+{
+	struct JobState
+	{
+		std::unique_ptr<Job>         job;
+		Heuristic                    heuristic = Heuristic::kWeightSum;
+		std::vector<ScreenshotStats> stats;
+		std::atomic<size_t>          num_remaining{0}; // Screenshots left; the last one finishes the job.
+		size_t                       next_same_name = kInvalidIndex; // Entry to start after this one.
+	};
+	std::vector<std::unique_ptr<JobState>> states;
+	std::unordered_map<std::string, size_t> last_with_name;
+	for (const auto j : irange(entries.size())) {
+		states.emplace_back(new JobState);
+		const auto it = last_with_name.find(entries[j].name);
+		if (it != last_with_name.end()) {
+			states[it->second]->next_same_name = j;
+		}
+		last_with_name[entries[j].name] = j;
+	}
+
+	ThreadPool pool(options.num_jobs);
+	std::function<void(size_t)> start_job;
+
+	const auto finish_job = [&](size_t j) {
+		states[j]->job.reset();
+		if (states[j]->next_same_name != kInvalidIndex) {
+			start_job(states[j]->next_same_name);
+		}
+	};
+
+	start_job = [&](size_t j) {
+		pool.push([&, j]() {
+			const auto& entry = entries[j];
+			auto& state = *states[j];
+			LOG_SCOPE_F(INFO, "%s%s", entry.tiled ? "Tiled " : "", entry.name.c_str());
+			state.job.reset(new Job(make_job(entry.name, *entry.config, make_model(image_dir, entry))));
+			if (!entry.tiled) {
+				entry.config->check_dangling();
+			}
+			if (options.export_gif && state.job->portfolio > 1) {
+				LOG_F(WARNING, "Not exporting GIF images: not supported with a portfolio of attempts");
+			}
+
+			state.heuristic = state.job->model->_heuristic;
+			state.stats.resize(state.job->screenshots);
+			state.num_remaining = state.job->screenshots;
+			if (state.job->screenshots == 0) {
+				finish_job(j);
+				return;
+			}
+
+			for (const auto i : irange(state.job->screenshots)) {
+				pool.push([&, j, i]() {
+					state.stats[i] = run_screenshot(options, *state.job, i);
+					if (--state.num_remaining == 0) {
+						finish_job(j);
+					}
+				});
 			}
+		});
+	};
+
+	for (const auto j : irange(entries.size())) {
+		const bool is_first_with_name = std::none_of(states.begin(), states.begin() + j,
+			[&](const std::unique_ptr<JobState>& state) { return state->next_same_name == j; });
+		if (is_first_with_name) {
+			start_job(j);
 		}
 	}
+
+	pool.wait();
+
+	for (const auto j : irange(entries.size())) {
+		log_stats(options, entries[j].name, states[j]->heuristic, states[j]->stats);
+	}
 }
 
 void run_config_file(const Options& options, const std::string& path)
@@ -54,24 +434,121 @@ void run_config_file(const Options& options, const std::string& path)
 	const auto samples = configuru::parse_file(path, configuru::CFG);
 	const auto image_dir = samples["image_dir"].as_string();
 
+	std::vector<JobEntry> entries;
 	if (samples.count("overlapping")) {
 		for (const auto& p : samples["overlapping"].as_object()) {
-			LOG_SCOPE_F(INFO, "%s", p.key().c_str());
-			const auto model = make_overlapping(image_dir, p.value());
-			run_and_write(options, p.key(), p.value(), *model);
-			p.value().check_dangling();
+			entries.push_back(JobEntry{p.key(), &p.value(), false});
 		}
 	}
-
 	if (samples.count("tiled")) {
 		for (const auto& p : samples["tiled"].as_object()) {
-			LOG_SCOPE_F(INFO, "Tiled %s", p.key().c_str());
-			const auto model = make_tiled(image_dir, p.value());
-			run_and_write(options, p.key(), p.value(), *model);
+			entries.push_back(JobEntry{p.key(), &p.value(), true});
+		}
+	}
+
+	if (options.dry_run) {
+		print_dry_run(image_dir, entries);
+		return;
+	}
+
+	if (options.verify) {
+		for (const auto& entry : entries) {
+			LOG_SCOPE_F(INFO, "Verifying %s%s", entry.tiled ? "tiled " : "", entry.name.c_str());
+			verify_job(image_dir, entry);
+		}
+		return;
+	}
+
+	if (options.num_jobs > 1 && options.batch_size == 0) {
+		run_jobs_in_pool(options, image_dir, entries);
+		return;
+	}
+
+	std::unique_ptr<PerfCounters> perf;
+	if (options.perf) {
+		perf.reset(new PerfCounters); // Counts this thread, which is the only one when benchmarking.
+	}
+
+	for (const auto& entry : entries) {
+		LOG_SCOPE_F(INFO, "%s%s", entry.tiled ? "Tiled " : "", entry.name.c_str());
+		TraceScope trace("job");
+		if (trace_enabled()) {
+			trace.set_args("\"job\": " + json_string(entry.name));
+		}
+
+		BenchStats bench;
+		const auto start_time = std::chrono::steady_clock::now();
+		uint64_t perf_start[kNumPerfEvents];
+		if (options.bench) {
+			current_bench() = &bench;
+			bench.peak_live_bytes = num_live_bytes();
+			if (perf && perf->read(perf_start)) {
+				bench.perf = perf.get();
+			}
+		}
+
+		auto job = make_job(entry.name, *entry.config, make_model(image_dir, entry));
+		if (options.bench) {
+			job.portfolio = 1; // Other threads would not be measured.
+		}
+		if (options.batch_size > 0) {
+			run_batch_and_write(options, job);
+		} else {
+			run_and_write(options, job);
+		}
+		if (!entry.tiled) {
+			entry.config->check_dangling();
+		}
+
+		if (options.bench) {
+			current_bench() = nullptr;
+			bench.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+			uint64_t perf_end[kNumPerfEvents];
+			if (bench.perf && perf->read(perf_end)) {
+				for (size_t i = 0; i < kNumPerfEvents; ++i) {
+					bench.perf_total[i] = perf_end[i] - perf_start[i];
+				}
+			}
+			const auto bench_path = emilib::strprintf("output/bench_%s%s.json", entry.tiled ? "tiled_" : "",
+			                                          entry.name.c_str());
+			CHECK_F(write_bench_json(bench_path, entry.name, bench), "Failed to write %s", bench_path.c_str());
+			LOG_F(INFO, "%s: %lu attempts, %lu iterations, %.3f s. Wrote %s", entry.name.c_str(),
+			      bench.num_attempts, bench.num_iterations, bench.total_seconds, bench_path.c_str());
+			if (alloc_tracking_enabled()) {
+				const auto sum = [](const size_t* values) {
+					return std::accumulate(values, values + kNumPhases + 1, size_t(0));
+				};
+				LOG_F(INFO, "%s: %lu allocations, %.1f MB allocated, peak of %.1f MB live", entry.name.c_str(),
+				      sum(bench.num_allocations), sum(bench.bytes_allocated) / 1e6, bench.peak_live_bytes / 1e6);
+			}
+			if (bench.perf) {
+				const auto&  propagate  = bench.perf_counts[static_cast<size_t>(Phase::kPropagate)];
+				const double cycles     = std::max<uint64_t>(propagate[static_cast<size_t>(PerfEvent::kCycles)], 1);
+				const double calls      = std::max<size_t>(bench.num_propagate_calls, 1);
+				LOG_F(INFO, "%s: propagate: %.2f instructions per cycle, %.1f cache misses and %.1f branch misses "
+				      "per call", entry.name.c_str(),
+				      propagate[static_cast<size_t>(PerfEvent::kInstructions)] / cycles,
+				      propagate[static_cast<size_t>(PerfEvent::kCacheMisses)]  / calls,
+				      propagate[static_cast<size_t>(PerfEvent::kBranchMisses)] / calls);
+				LOG_F(INFO, "%s: read the counters %lu times, at ~%lu cycles each, which the phases leave out",
+				      entry.name.c_str(), bench.num_perf_reads,
+				      bench.perf->read_cost()[static_cast<size_t>(PerfEvent::kCycles)]);
+			}
 		}
 	}
 }
 
+// The non-negative integer given to flag, or exits.
+size_t parse_count(const char* flag, const char* arg)
+{
+	char* end = nullptr;
+	errno = 0;
+	const long value = std::strtol(arg, &end, 10);
+	CHECK_F(end != arg && *end == '\0' && errno == 0 && value >= 0,
+	        "%s expects a non-negative integer, not '%s'", flag, arg);
+	return value;
+}
+
 int main(int argc, char* argv[])
 {
 	loguru::init(argc, argv);
@@ -79,6 +556,7 @@ int main(int argc, char* argv[])
 	Options options;
 
 	std::vector<std::string> files;
+	bool jobs_given = false;
 
 	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -87,11 +565,54 @@ int main(int argc, char* argv[])
 		} else if (strcmp(argv[i], "--gif") == 0) {
 			options.export_gif = true;
 			LOG_F(INFO, "Enabled GIF exporting");
+		} else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+			options.num_jobs = parse_count("--jobs", argv[++i]);
+			jobs_given = true;
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			options.batch_size = parse_count("--batch", argv[++i]);
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			options.bench = true;
+		} else if (strcmp(argv[i], "--perf") == 0) {
+			options.bench = true;
+			options.perf  = true;
+		} else if (strcmp(argv[i], "--allocs") == 0) {
+			options.bench = true;
+			alloc_tracking_enabled() = true;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			options.stats = true;
+		} else if (strcmp(argv[i], "--dry-run") == 0) {
+			options.dry_run = true;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			options.verify = true;
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			options.trace_path = argv[++i];
+			trace_enabled() = true;
 		} else {
 			files.push_back(argv[i]);
 		}
 	}
 
+	if (options.bench && (jobs_given || options.batch_size > 0)) {
+		LOG_F(WARNING, "Ignoring --jobs and --batch: --bench runs one job at a time, on one thread");
+	}
+	if (options.bench) {
+		options.num_jobs   = 1;
+		options.batch_size = 0;
+		jobs_given         = true;
+	}
+	if (options.num_jobs == 0 || (options.batch_size > 0 && !jobs_given)) {
+		options.num_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	if (options.num_jobs > 1) {
+		LOG_F(INFO, "Running on up to %lu threads", options.num_jobs);
+	}
+	if (options.stats && !WFC_STATS) {
+		LOG_F(WARNING, "--stats: built with WFC_STATS=0, so every counter will be zero");
+	}
+	if (options.export_gif && options.batch_size > 0) {
+		LOG_F(WARNING, "Not exporting GIF images: not supported with --batch");
+	}
+
 	if (files.empty()) {
 		files.push_back("samples.cfg");
 	}
@@ -99,4 +620,9 @@ int main(int argc, char* argv[])
 	for (const auto& file : files) {
 		run_config_file(options, file);
 	}
+
+	if (trace_enabled()) {
+		CHECK_F(write_trace_json(options.trace_path), "Failed to write %s", options.trace_path.c_str());
+		LOG_F(INFO, "Wrote trace to %s", options.trace_path.c_str());
+	}
 }
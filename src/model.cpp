@@ -0,0 +1,104 @@
+#include "model.hh"
+
+double Model::selection_key(const CellEntropy& cell, int x, int y, double noise) const
+{
+	switch (_heuristic) {
+		case Heuristic::kWeightSum:    return cell.sum_of_weights + 0.5 * noise;
+		case Heuristic::kEntropy:      return cell.entropy + 1e-6 * noise;
+		case Heuristic::kMinRemaining: return cell.num_possible + 0.5 * noise;
+		case Heuristic::kScanline:     return y * _width + x;
+		case Heuristic::kRandom:       return noise;
+	}
+	return noise;
+}
+
+static void update_entropy(CellEntropy* cell)
+{
+	cell->entropy = cell->sum_of_weights > 0
+		? std::log(cell->sum_of_weights) - cell->sum_of_weight_log_weights / cell->sum_of_weights
+		: 0.0;
+}
+
+void Model::ban(Output* output, int x, int y, size_t t) const
+{
+	DCHECK_F(output->_wave.get(x, y, t), "Pattern %lu is already banned", t);
+	output->_wave.set(x, y, t, false);
+	WFC_COUNT(output, patterns_banned, 1);
+
+	if (output->_record_trail) {
+		output->_trail.push_back(Ban{x, y, static_cast<PatternIndex>(t)});
+	}
+
+	auto& cell = output->_entropy.mut_ref(x, y);
+	cell.num_possible              -= 1;
+	cell.sum_of_weights            -= _pattern_weight[t];
+	cell.sum_of_weight_log_weights -= _weight_log_weight[t];
+	update_entropy(&cell);
+
+	if ((cell.num_possible == 0 || cell.sum_of_weights <= 0) && !on_boundary(x, y)) {
+		output->_contradiction = true;
+	}
+
+	const size_t index = x * _height + y;
+	if (output->_heap.contains(index)) {
+		if (cell.num_possible <= 1) {
+			output->_heap.remove(index);
+		} else if (_heuristic != Heuristic::kScanline && _heuristic != Heuristic::kRandom) {
+			output->_heap.update(index, selection_key(cell, x, y, output->_noise[index]));
+		}
+	}
+
+	if (_propagation == Propagation::kQueue) {
+		output->_stack.push_back(Ban{x, y, static_cast<PatternIndex>(t)});
+	} else {
+		output->_changes.set(x, y, true);
+	}
+}
+
+void Model::unban(Output* output, const Ban& banned) const
+{
+	const int x = banned.x;
+	const int y = banned.y;
+	const size_t t = banned.t;
+	DCHECK_F(!output->_wave.get(x, y, t), "Pattern %lu is not banned", t);
+	output->_wave.set(x, y, t, true);
+
+	auto& cell = output->_entropy.mut_ref(x, y);
+	cell.num_possible              += 1;
+	cell.sum_of_weights            += _pattern_weight[t];
+	cell.sum_of_weight_log_weights += _weight_log_weight[t];
+	update_entropy(&cell);
+
+	if (!on_boundary(x, y) && cell.num_possible > 1) {
+		const size_t index = x * _height + y;
+		const double key = selection_key(cell, x, y, output->_noise[index]);
+		if (!output->_heap.contains(index)) {
+			output->_heap.push(index, key);
+		} else if (_heuristic != Heuristic::kScanline && _heuristic != Heuristic::kRandom) {
+			output->_heap.update(index, key);
+		}
+	}
+
+	if (_propagation == Propagation::kQueue) {
+		restore_support(output, banned);
+	}
+}
+
+ModelReport Model::output_report(size_t num_directions) const
+{
+	const size_t num_cells = _width * _height;
+
+	ModelReport report;
+	report.num_patterns   = _num_patterns;
+	report.num_directions = num_directions;
+	report.wave_bytes     = num_cells * num_words_for(_num_patterns) * sizeof(Word);
+	report.output_bytes   = report.wave_bytes
+	                      + num_cells * (sizeof(Bool) + sizeof(CellEntropy) + sizeof(double))
+	                      + num_cells * IndexedMinHeap::bytes_per_item();
+	if (_propagation == Propagation::kQueue) {
+		report.output_bytes += num_cells * _num_patterns * num_directions * sizeof(SupportCount);
+	}
+	// Each pattern is banned from each cell at most once before it is unbanned, and each cell observed once:
+	report.trail_bytes = num_cells * (_num_patterns - 1) * sizeof(Ban) + num_cells * sizeof(Decision);
+	return report;
+}
@@ -3,65 +3,260 @@
 Output create_output(const Model& model)
 {
 	Output output;
-	output._wave = Array3D<Bool>(model._width, model._height, model._num_patterns, true);
+	output._wave = BitArray3D(model._width, model._height, model._num_patterns, true);
 	output._changes = Array2D<Bool>(model._width, model._height, false);
 
-	if (model._foundation != kInvalidIndex) {
-		for (const auto x : irange(model._width)) {
+	CellEntropy all_possible{model._num_patterns, 0.0, 0.0, 0.0};
+	for (const auto t : irange(model._num_patterns)) {
+		all_possible.sum_of_weights            += model._pattern_weight[t];
+		all_possible.sum_of_weight_log_weights += model._weight_log_weight[t];
+	}
+	all_possible.entropy = std::log(all_possible.sum_of_weights)
+		- all_possible.sum_of_weight_log_weights / all_possible.sum_of_weights;
+	output._entropy = Array2D<CellEntropy>(model._width, model._height, all_possible);
+
+	if (model._propagation == Propagation::kQueue) {
+		const auto num_directions = model._initial_compatible.height();
+		output._compatible = Array3D<SupportCount>(model._width * model._height, model._num_patterns, num_directions);
+		for (const auto cell : irange(model._width * model._height)) {
 			for (const auto t : irange(model._num_patterns)) {
-				if (t != model._foundation) {
-					output._wave.set(x, model._height - 1, t, false);
+				for (const auto d : irange(num_directions)) {
+					output._compatible.set(cell, t, d, model._initial_compatible.get(t, d));
 				}
 			}
-			output._changes.set(x, model._height - 1, true);
+		}
+	}
 
-			for (const auto y : irange(model._height - 1)) {
-				output._wave.set(x, y, model._foundation, false);
-				output._changes.set(x, y, true);
-			}
+	if (model._foundation != kInvalidIndex) {
+		// The foundation pattern on the bottom row, and nowhere else:
+		const int bottom = model._height - 1;
+		constrain(model, &output, [&](int x, int y, size_t t) {
+			return (y == bottom) == (t == model._foundation);
+		});
+	}
 
-			while (model.propagate(&output));
+	return output;
+}
+
+void constrain(const Model& model, Output* output, const std::function<bool(int x, int y, size_t t)>& allowed)
+{
+	for (const auto x : irange(model._width)) {
+		for (const auto y : irange(model._height)) {
+			output->_wave.for_each(x, y, [&](size_t t) {
+				if (!allowed(x, y, t)) {
+					model.ban(output, x, y, t);
+				}
+			});
 		}
 	}
 
-	return output;
+	PhaseTimer timer(Phase::kPropagate);
+	propagate_all(model, output);
+}
+
+void reset_output(const Model& model, Output* output)
+{
+	if (model._initial_output._wave.size() == 0) {
+		*output = create_output(model);
+	} else {
+		*output = model._initial_output;
+	}
+	output->_counters = SolverCounters();
+}
+
+void init_heap(const Model& model, Output* output, RandomEngine& rng)
+{
+	output->_heap.reset(model._width * model._height);
+	output->_noise.assign(model._width * model._height, 0.0);
+
+	for (int x = 0; x < model._width; ++x) {
+		for (int y = 0; y < model._height; ++y) {
+			if (model.on_boundary(x, y)) { continue; }
+
+			const auto& cell = output->_entropy.ref(x, y);
+			if (cell.num_possible <= 1) { continue; }
+
+			const size_t index = x * model._height + y;
+			output->_noise[index] = rng.next_double();
+			output->_heap.push(index, model.selection_key(cell, x, y, output->_noise[index]));
+		}
+	}
 }
 
-Result observe(const Model& model, Output* output, RandomDouble& random_double)
+Result observe(const Model& model, Output* output, RandomEngine& rng)
 {
 	int argminx, argminy;
-	const auto result = find_lowest_entropy(model, *output, random_double, &argminx, &argminy);
+	const auto result = find_lowest_entropy(model, *output, &argminx, &argminy);
 	if (result != Result::kUnfinished) { return result; }
+	WFC_COUNT(output, observations, 1);
 
-	std::vector<double> distribution(model._num_patterns);
-	for (int t = 0; t < model._num_patterns; ++t) {
-		distribution[t] = output->_wave.get(argminx, argminy, t) ? model._pattern_weight[t] : 0;
+	const size_t r = spin_the_bottle(output->_wave.words(argminx, argminy), output->_wave.num_words(),
+	                                 model._pattern_weight, output->_entropy.ref(argminx, argminy).sum_of_weights,
+	                                 rng.next_double());
+	if (output->_record_trail) {
+		output->_decisions.push_back(Decision{output->_trail.size(), argminx, argminy, static_cast<PatternIndex>(r)});
 	}
-	size_t r = spin_the_bottle(std::move(distribution), random_double());
-	for (int t = 0; t < model._num_patterns; ++t) {
-		output->_wave.set(argminx, argminy, t, t == r);
-	}
-	output->_changes.set(argminx, argminy, true);
+	output->_wave.for_each(argminx, argminy, [&](size_t t) {
+		if (t != r) {
+			model.ban(output, argminx, argminy, t);
+		}
+	});
 
 	return Result::kUnfinished;
 }
 
-Result run(Output* output, const Model& model, size_t seed, size_t limit, jo_gif_t* gif_out)
+void propagate_all(const Model& model, Output* output)
+{
+	size_t num_calls = 1;
+	while (model.propagate(output)) {
+		num_calls += 1;
+	}
+	if (BenchStats* bench = current_bench()) {
+		bench->num_propagate_calls += num_calls;
+	}
+}
+
+size_t backtrack(const Model& model, Output* output, size_t max_undone)
 {
-	std::mt19937 gen(seed);
-	std::uniform_real_distribution<double> dis(0.0, 1.0);
-	RandomDouble random_double = [&]() { return dis(gen); };
+	DCHECK_F(output->_stack.empty(), "Backtracking before propagation finished");
 
+	size_t num_undone = 0;
+	while (!output->_decisions.empty() && num_undone < max_undone) {
+		const Decision decision = output->_decisions.back();
+		output->_decisions.pop_back();
+
+		while (output->_trail.size() > decision.trail_size) {
+			model.unban(output, output->_trail.back());
+			output->_trail.pop_back();
+		}
+		output->_contradiction = false;
+		num_undone += 1;
+
+		model.ban(output, decision.x, decision.y, decision.t);
+		propagate_all(model, output);
+
+		if (!output->_contradiction) {
+			break;
+		}
+	}
+
+	return num_undone;
+}
+
+// The most recent copies of the output, taken every options.checkpoint_interval observations.
+// The buffers are reused, so after the first few checkpoints taking one does not allocate.
+struct Checkpoints
+{
+	std::vector<Output> ring;          // num_checkpoints
+	size_t              num_taken = 0; // The newest checkpoint is ring[(num_taken - 1) % ring.size()]
+	size_t              num_valid = 0; // How many of the newest checkpoints we can still roll back to.
+
+	void take(const Output& output)
+	{
+		ring[num_taken % ring.size()] = output;
+		num_taken += 1;
+		num_valid = std::min(num_valid + 1, ring.size());
+	}
+
+	// Roll back to the depth:th newest checkpoint, or the oldest one if there are fewer, forgetting
+	// newer ones. False if there is none.
+	bool roll_back(size_t depth, Output* output)
+	{
+		if (num_valid == 0) { return false; }
+		depth = std::max<size_t>(std::min(depth, num_valid), 1);
+		num_taken -= depth - 1;
+		num_valid -= depth - 1;
+		const SolverCounters counters = output->_counters;
+		*output = ring[(num_taken - 1) % ring.size()];
+		output->_counters = counters;
+		return true;
+	}
+};
+
+Result run(Output* output, const Model& model, uint64_t seed, const SolverOptions& options, jo_gif_t* gif_out,
+           const std::atomic<bool>* cancel)
+{
+	RandomEngine rng(seed);
+
+	init_heap(model, output, rng);
+	output->_record_trail = options.max_backtracks > 0;
+	size_t num_backtracks = 0;
+
+	Checkpoints checkpoints;
+	size_t num_rollbacks = 0;
+	size_t num_failed_since_checkpoint = 0;
+	size_t observations_since_checkpoint = 0;
+	if (options.max_rollbacks > 0) {
+		checkpoints.ring.resize(std::max<size_t>(options.num_checkpoints, 1));
+		checkpoints.take(*output);
+	}
+
+	const auto finish = [&](Result result, size_t num_iterations) {
+		WFC_COUNT(output, restarts, result == Result::kFail);
+		if (BenchStats* bench = current_bench()) {
+			bench->num_attempts   += 1;
+			bench->num_successes  += result == Result::kSuccess;
+			bench->num_iterations += num_iterations;
+			bench->num_backtracks += num_backtracks;
+			bench->num_rollbacks  += num_rollbacks;
+		}
+		return result;
+	};
+
+	const auto& name = current_attempt_name();
+	const auto log_prefix = name.empty() ? std::string() : name + ": ";
+
+	const size_t limit = options.limit;
 	for (size_t l = 0; l < limit || limit == 0; ++l) {
-		Result result = observe(model, output, random_double);
+		if (cancel && cancel->load(std::memory_order_relaxed)) {
+			LOG_F(INFO, "%sCancelled after %lu iterations", log_prefix.c_str(), l);
+			return finish(Result::kUnfinished, l);
+		}
+
+		Result result;
+		{
+			PhaseTimer timer(Phase::kObserve);
+			result = observe(model, output, rng);
+		}
+		WFC_COUNT(output, contradictions, result == Result::kFail);
+
+		if (result == Result::kFail && num_backtracks < options.max_backtracks) {
+			PhaseTimer timer(Phase::kPropagate);
+			const size_t num_undone = backtrack(model, output, options.max_backtracks - num_backtracks);
+			num_backtracks += num_undone;
+			WFC_COUNT(output, backtracks, num_undone);
+			if (!output->_contradiction) {
+				continue;
+			}
+		}
+
+		if (result == Result::kFail && num_rollbacks < options.max_rollbacks) {
+			num_failed_since_checkpoint += 1;
+			const size_t depth = options.restart_schedule == RestartSchedule::kLuby
+				? luby(num_failed_since_checkpoint)
+				: size_t(1) << std::min<size_t>(num_failed_since_checkpoint - 1, 63);
+			if (checkpoints.roll_back(depth, output)) {
+				num_rollbacks += 1;
+				WFC_COUNT(output, rollbacks, 1);
+				observations_since_checkpoint = 0;
+				rng = RandomEngine(substream_seed(seed, num_rollbacks));
+				continue;
+			}
+		}
 
 		if (gif_out && l % kGifInterval == 0) {
+			PhaseTimer timer(Phase::kRender);
 			const auto image = model.image(*output);
+			PhaseTimer encode_timer(Phase::kEncode);
 			jo_gif_frame(gif_out, (uint8_t*)image.data(), kGifDelayCentiSec, kGifSeparatePalette);
 		}
 
 		if (result != Result::kUnfinished) {
+			DCHECK_F(result != Result::kSuccess || model.is_consistent(*output),
+			         "Finished output has incompatible neighbors");
+
 			if (gif_out) {
+				PhaseTimer timer(Phase::kEncode);
 				// Pause on the last image:
 				auto image = model.image(*output);
 				jo_gif_frame(gif_out, (uint8_t*)image.data(), kGifEndPauseCentiSec, kGifSeparatePalette);
@@ -75,65 +270,69 @@ Result run(Output* output, const Model& model, size_t seed, size_t limit, jo_gif
 				}
 			}
 
-			LOG_F(INFO, "%s after %lu iterations", result2str(result), l);
-			return result;
+			LOG_F(INFO, "%s%s after %lu iterations, %lu backtracks, %lu rollbacks",
+			      log_prefix.c_str(), result2str(result), l, num_backtracks, num_rollbacks);
+			return finish(result, l);
+		}
+
+		{
+			PhaseTimer timer(Phase::kPropagate);
+			propagate_all(model, output);
+		}
+
+		if (options.max_rollbacks > 0 && !output->_contradiction
+		    && ++observations_since_checkpoint >= options.checkpoint_interval) {
+			checkpoints.take(*output);
+			num_failed_since_checkpoint = 0;
+			observations_since_checkpoint = 0;
 		}
-		while (model.propagate(output));
 	}
 
-	LOG_F(INFO, "Unfinished after %lu iterations", limit);
-	return Result::kUnfinished;
+	LOG_F(INFO, "%sUnfinished after %lu iterations", log_prefix.c_str(), limit);
+	return finish(Result::kUnfinished, limit);
 }
 
-Result find_lowest_entropy(const Model& model, const Output& output, RandomDouble& random_double,
-                           int* argminx, int* argminy)
+Result find_lowest_entropy(const Model& model, const Output& output, int* argminx, int* argminy)
 {
-	// We actually calculate exp(entropy), i.e. the sum of the weights of the possible patterns
-
-	double min = std::numeric_limits<double>::infinity();
-
-	for (int x = 0; x < model._width; ++x) {
-		for (int y = 0; y < model._height; ++y) {
-			if (model.on_boundary(x, y)) { continue; }
-
-			size_t num_superimposed = 0;
-			double entropy = 0;
-
-			for (int t = 0; t < model._num_patterns; ++t) {
-				if (output._wave.get(x, y, t)) {
-					num_superimposed += 1;
-					entropy += model._pattern_weight[t];
-				}
-			}
-
-			if (entropy == 0 || num_superimposed == 0) {
-				return Result::kFail;
-			}
-
-			if (num_superimposed == 1) {
-				continue; // Already frozen
-			}
-
-			// Add a tie-breaking bias:
-			const double noise = 0.5 * random_double();
-			entropy += noise;
-
-			if (entropy < min) {
-				min = entropy;
-				*argminx = x;
-				*argminy = y;
-			}
-		}
+	if (output._contradiction) {
+		return Result::kFail;
 	}
 
-	if (min == std::numeric_limits<double>::infinity()) {
+	if (output._heap.empty()) {
 		return Result::kSuccess;
-	} else {
-		return Result::kUnfinished;
 	}
+
+	const size_t index = output._heap.top();
+	*argminx = index / model._height;
+	*argminy = index % model._height;
+	return Result::kUnfinished;
 }
 
-std::unique_ptr<Model> make_overlapping(const std::string& image_dir, const configuru::Config& config)
+SolverOptions read_solver_options(const configuru::Config& config)
+{
+	SolverOptions options;
+	options.limit               = config.get_or("limit",                 0);
+	options.max_backtracks      = config.get_or("backtracks",            0);
+	options.max_rollbacks       = config.get_or("rollbacks",             0);
+	options.checkpoint_interval = config.get_or("checkpoint_interval", 100);
+	options.num_checkpoints     = config.get_or("checkpoints",           4);
+	options.restart_schedule    = str2restart_schedule(config.get_or("restart_schedule", std::string("luby")));
+	return options;
+}
+
+void log_report(const Model& model)
+{
+	const auto report = model.report();
+	LOG_F(INFO, "%lu patterns, %lu directions, propagator %.1f%% dense (%s), %lux%lu output: wave %s, "
+	      "%s per attempt, ~%.0f propagator entries per observation",
+	      report.num_patterns, report.num_directions, 100 * report.density(),
+	      bytes2str(report.propagator_bytes).c_str(), model._width, model._height,
+	      bytes2str(report.wave_bytes).c_str(), bytes2str(report.output_bytes).c_str(),
+	      report.cost_per_observation());
+}
+
+std::unique_ptr<Model> make_overlapping(const std::string& image_dir, const configuru::Config& config,
+                                        bool build_initial_output)
 {
 	const auto image_filename = config["image"].as_string();
 	const auto in_path = image_dir + image_filename;
@@ -145,28 +344,54 @@ std::unique_ptr<Model> make_overlapping(const std::string& image_dir, const conf
 	const bool   periodic_out   = config.get_or("periodic_out", true);
 	const bool   periodic_in    = config.get_or("periodic_in",  true);
 	const auto   has_foundation = config.get_or("foundation",   false);
-
-	const auto sample_image = load_paletted_image(in_path.c_str());
+	const auto   propagation    = str2propagation(config.get_or("propagation", std::string("queue")));
+	// Queue propagation keeps a support count per cell, pattern and direction, so with all
+	// (2n - 1)^2 - 1 overlap directions it takes many times the memory of sweep for no speedup.
+	const bool   orthogonal     = config.get_or("orthogonal_propagation", propagation == Propagation::kQueue);
+	const auto   cache_path     = config.get_or("propagator_cache", std::string());
+	const auto   heuristic      = str2heuristic(config.get_or("heuristic", std::string("weight_sum")));
+
+	PalettedImage sample_image;
+	{
+		PhaseTimer timer(Phase::kImageLoad);
+		sample_image = load_paletted_image(in_path.c_str());
+	}
 	LOG_F(INFO, "palette size: %lu", sample_image.palette.size());
 	PatternHash foundation = kInvalidHash;
-	const auto hashed_patterns = extract_patterns(sample_image, n, periodic_in, symmetry, has_foundation ? &foundation : nullptr);
+	PatternPrevalence hashed_patterns;
+	{
+		PhaseTimer timer(Phase::kPatternExtraction);
+		hashed_patterns = extract_patterns(sample_image, n, periodic_in, symmetry, has_foundation ? &foundation : nullptr);
+	}
 	LOG_F(INFO, "Found %lu unique patterns in sample image", hashed_patterns.size());
 
-	return std::unique_ptr<Model>{
-		new OverlappingModel{hashed_patterns, sample_image.palette, n, periodic_out, out_width, out_height, foundation}
+	PhaseTimer timer(Phase::kPropagatorBuild);
+	std::unique_ptr<Model> model{
+		new OverlappingModel{hashed_patterns, sample_image.palette, n, periodic_out, out_width, out_height,
+		                     foundation, propagation, orthogonal, cache_path}
 	};
+	model->_heuristic = heuristic;
+	log_report(*model);
+	if (build_initial_output) {
+		model->_initial_output = create_output(*model);
+	}
+	return model;
 }
 
-std::unique_ptr<Model> make_tiled(const std::string& image_dir, const configuru::Config& config)
+std::unique_ptr<Model> make_tiled(const std::string& image_dir, const configuru::Config& config,
+                                  bool build_initial_output)
 {
-	const std::string subdir     = config["subdir"].as_string();
-	const size_t      out_width  = config.get_or("width",    48);
-	const size_t      out_height = config.get_or("height",   48);
-	const std::string subset     = config.get_or("subset",   std::string());
-	const bool        periodic   = config.get_or("periodic", false);
+	const std::string subdir      = config["subdir"].as_string();
+	const size_t      out_width   = config.get_or("width",    48);
+	const size_t      out_height  = config.get_or("height",   48);
+	const std::string subset      = config.get_or("subset",   std::string());
+	const bool        periodic    = config.get_or("periodic", false);
+	const auto        propagation = str2propagation(config.get_or("propagation", std::string("queue")));
+	const auto        heuristic   = str2heuristic(config.get_or("heuristic", std::string("weight_sum")));
 
 	const TileLoader tile_loader = [&](const std::string& tile_name) -> Tile
 	{
+		PhaseTimer timer(Phase::kImageLoad);
 		const std::string path = emilib::strprintf("%s%s/%s.bmp", image_dir.c_str(), subdir.c_str(), tile_name.c_str());
 		int width, height, comp;
 		RGBA* rgba = reinterpret_cast<RGBA*>(stbi_load(path.c_str(), &width, &height, &comp, 4));
@@ -179,7 +404,14 @@ std::unique_ptr<Model> make_tiled(const std::string& image_dir, const configuru:
 
 	const auto root_dir = image_dir + subdir + "/";
 	const auto tile_config = configuru::parse_file(root_dir + "data.cfg", configuru::CFG);
-	return std::unique_ptr<Model>{
-		new TileModel(tile_config, subset, out_width, out_height, periodic, tile_loader)
+	PhaseTimer timer(Phase::kPropagatorBuild);
+	std::unique_ptr<Model> model{
+		new TileModel(tile_config, subset, out_width, out_height, periodic, propagation, tile_loader)
 	};
+	model->_heuristic = heuristic;
+	log_report(*model);
+	if (build_initial_output) {
+		model->_initial_output = create_output(*model);
+	}
+	return model;
 }
\ No newline at end of file
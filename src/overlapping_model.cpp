@@ -7,63 +7,231 @@ OverlappingModel::OverlappingModel(
 	bool                     periodic_out,
 	size_t                   width,
 	size_t                   height,
-	PatternHash              foundation_pattern)
+	PatternHash              foundation_pattern,
+	Propagation              propagation,
+	bool                     orthogonal_propagation,
+	const std::string&       propagator_cache)
 {
 	_width        = width;
 	_height       = height;
 	_num_patterns = hashed_patterns.size();
+	CHECK_F(_num_patterns <= std::numeric_limits<PatternIndex>::max(), "Too many patterns: %lu", _num_patterns);
 	_periodic_out = periodic_out;
+	_propagation  = propagation;
 	_n            = n;
 	_palette      = palette;
 
+	std::vector<PatternHash> hashes;
+
 	for (const auto& it : hashed_patterns) {
 		if (it.first == foundation_pattern) {
 			_foundation = _patterns.size();
 		}
 
+		hashes.push_back(it.first);
 		_patterns.push_back(pattern_from_hash(it.first, n, _palette.size()));
 		_pattern_weight.push_back(it.second);
+		_weight_log_weight.push_back(it.second * std::log(it.second));
 	}
 
-	const auto agrees = [&](const Pattern& p1, const Pattern& p2, int dx, int dy) {
-		int xmin = dx < 0 ? 0 : dx, xmax = dx < 0 ? dx + n : n;
-		int ymin = dy < 0 ? 0 : dy, ymax = dy < 0 ? dy + n : n;
-		for (int y = ymin; y < ymax; ++y) {
-			for (int x = xmin; x < xmax; ++x) {
-				if (p1[x + n * y] != p2[x - dx + n * (y - dy)]) {
-					return false;
+	for (int dx = -n + 1; dx < n; ++dx) {
+		for (int dy = -n + 1; dy < n; ++dy) {
+			const bool is_orthogonal = std::abs(dx) + std::abs(dy) == 1;
+			if ((dx != 0 || dy != 0) && (is_orthogonal || !orthogonal_propagation)) {
+				_offsets.push_back({{dx, dy}});
+			}
+		}
+	}
+
+	if (propagator_cache.empty() || !load_propagator(propagator_cache, hashes)) {
+		for (auto t : irange(_num_patterns)) {
+			for (const auto& offset : _offsets) {
+				for (auto t2 : irange(_num_patterns)) {
+					if (agrees(t, t2, offset[0], offset[1])) {
+						_propagator.push_back(t2);
+					}
 				}
+				_propagator.end_list();
 			}
 		}
-		return true;
-	};
+		_propagator.shrink_to_fit();
 
-	_propagator = Array3D<std::vector<PatternIndex>>(_num_patterns, 2 * n - 1, 2 * n - 1, {});
+		if (!propagator_cache.empty()) {
+			save_propagator(propagator_cache, hashes);
+		}
+	}
 
 	size_t longest_propagator = 0;
-	size_t sum_propagator = 0;
+	for (auto i : irange(_propagator.num_lists())) {
+		longest_propagator = std::max(longest_propagator, _propagator.list(i).size());
+	}
+
+	LOG_F(INFO, "propagator length: mean/max/sum: %.1f, %lu, %lu",
+	    (double)_propagator.num_values() / _propagator.num_lists(), longest_propagator, _propagator.num_values());
+
+	if (_propagation == Propagation::kQueue) {
+		_initial_compatible = Array2D<SupportCount>(_num_patterns, _offsets.size(), 0);
+		for (auto t : irange(_num_patterns)) {
+			for (auto d : irange(_offsets.size())) {
+				_initial_compatible.set(t, d, propagator(t, d).size());
+			}
+		}
+	}
+}
 
+bool OverlappingModel::agrees(size_t t1, size_t t2, int dx, int dy) const
+{
+	const Pattern& p1 = _patterns[t1];
+	const Pattern& p2 = _patterns[t2];
+	int xmin = dx < 0 ? 0 : dx, xmax = dx < 0 ? dx + _n : _n;
+	int ymin = dy < 0 ? 0 : dy, ymax = dy < 0 ? dy + _n : _n;
+	for (int y = ymin; y < ymax; ++y) {
+		for (int x = xmin; x < xmax; ++x) {
+			if (p1[x + _n * y] != p2[x - dx + _n * (y - dy)]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool OverlappingModel::propagator_is_symmetric() const
+{
+	// Lists are sorted, as ListArray::read() checks.
 	for (auto t : irange(_num_patterns)) {
-		for (auto x : irange<int>(2 * n - 1)) {
-			for (auto y : irange<int>(2 * n - 1)) {
-				auto& list = _propagator.mut_ref(t, x, y);
-				for (auto t2 : irange(_num_patterns)) {
-					if (agrees(_patterns[t], _patterns[t2], x - n + 1, y - n + 1)) {
-						list.push_back(t2);
-					}
-				}
-				list.shrink_to_fit();
-				longest_propagator = std::max(longest_propagator, list.size());
-				sum_propagator += list.size();
+		for (auto d : irange(_offsets.size())) {
+			for (const auto t2 : propagator(t, d)) {
+				const auto back = propagator(t2, opposite_direction(d));
+				if (!std::binary_search(back.begin(), back.end(), t)) { return false; }
 			}
 		}
 	}
+	return true;
+}
 
-	LOG_F(INFO, "propagator length: mean/max/sum: %.1f, %lu, %lu",
-	    (double)sum_propagator / _propagator.size(), longest_propagator, sum_propagator);
+const uint32_t kPropagatorMagic   = 0x50434657; // "WFCP"
+const uint32_t kPropagatorVersion = 2;          // Bump whenever the format changes.
+
+bool OverlappingModel::load_propagator(const std::string& path, const std::vector<PatternHash>& hashes)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) { return false; }
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	int32_t n = 0;
+	// Hashes are decoded with the palette size, so the same hashes can be other patterns:
+	uint64_t palette_size = 0;
+	uint64_t num_patterns = 0;
+	bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == kPropagatorMagic
+	       && fread(&version, sizeof(version), 1, file) == 1 && version == kPropagatorVersion
+	       && fread(&n, sizeof(n), 1, file) == 1 && n == _n
+	       && fread(&palette_size, sizeof(palette_size), 1, file) == 1 && palette_size == _palette.size()
+	       && fread(&num_patterns, sizeof(num_patterns), 1, file) == 1 && num_patterns == hashes.size();
+
+	if (ok) {
+		std::vector<PatternHash> cached_hashes(num_patterns);
+		ok = fread(cached_hashes.data(), sizeof(PatternHash), num_patterns, file) == num_patterns
+		  && cached_hashes == hashes
+		  && _propagator.read(file, num_patterns * _offsets.size(), num_patterns)
+		  && propagator_is_symmetric();
+	}
+
+	fclose(file);
+
+	if (ok) {
+		LOG_F(INFO, "Loaded propagator from %s", path.c_str());
+	} else {
+		LOG_F(WARNING, "Ignoring stale or invalid propagator cache %s", path.c_str());
+		_propagator = {};
+	}
+	return ok;
+}
+
+void OverlappingModel::save_propagator(const std::string& path, const std::vector<PatternHash>& hashes) const
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		LOG_F(WARNING, "Failed to open %s for writing", path.c_str());
+		return;
+	}
+
+	const int32_t n = _n;
+	const uint64_t palette_size = _palette.size();
+	const uint64_t num_patterns = hashes.size();
+	const bool ok = fwrite(&kPropagatorMagic, sizeof(kPropagatorMagic), 1, file) == 1
+	             && fwrite(&kPropagatorVersion, sizeof(kPropagatorVersion), 1, file) == 1
+	             && fwrite(&n, sizeof(n), 1, file) == 1
+	             && fwrite(&palette_size, sizeof(palette_size), 1, file) == 1
+	             && fwrite(&num_patterns, sizeof(num_patterns), 1, file) == 1
+	             && fwrite(hashes.data(), sizeof(PatternHash), hashes.size(), file) == hashes.size()
+	             && _propagator.write(file);
+
+	fclose(file);
+
+	if (!ok) {
+		LOG_F(WARNING, "Failed to write propagator to %s", path.c_str());
+	}
 }
 
 bool OverlappingModel::propagate(Output* output) const
+{
+	WFC_COUNT(output, propagate_calls, 1);
+	if (_propagation == Propagation::kQueue) {
+		return propagate_queue(output);
+	} else {
+		return propagate_sweep(output);
+	}
+}
+
+bool OverlappingModel::propagate_queue(Output* output) const
+{
+	bool did_change = false;
+
+	while (!output->_stack.empty()) {
+		const Ban banned = output->_stack.back();
+		output->_stack.pop_back();
+		did_change = true;
+
+		for (size_t d = 0; d < _offsets.size(); ++d) {
+			int sx, sy;
+			if (!neighbor(banned.x, banned.y, d, &sx, &sy)) { continue; }
+
+			// Seen from sx, sy the banned pattern lies in the opposite direction:
+			const size_t opposite = opposite_direction(d);
+
+			const auto prop = propagator(banned.t, d);
+			WFC_COUNT(output, cells_visited, 1);
+			WFC_COUNT(output, entries_scanned, prop.size());
+
+			for (const auto t2 : prop) {
+				auto& compatible = output->_compatible.mut_ref(sx * _height + sy, t2, opposite);
+				DCHECK_F(compatible > 0, "Support of pattern %u lost twice", unsigned(t2));
+				compatible -= 1;
+				if (compatible == 0 && output->_wave.get(sx, sy, t2)) {
+					ban(output, sx, sy, t2);
+				}
+			}
+		}
+	}
+
+	return did_change;
+}
+
+void OverlappingModel::restore_support(Output* output, const Ban& banned) const
+{
+	for (size_t d = 0; d < _offsets.size(); ++d) {
+		int sx, sy;
+		if (!neighbor(banned.x, banned.y, d, &sx, &sy)) { continue; }
+
+		const size_t opposite = opposite_direction(d);
+		for (const auto t2 : propagator(banned.t, d)) {
+			output->_compatible.mut_ref(sx * _height + sy, t2, opposite) += 1;
+		}
+	}
+}
+
+bool OverlappingModel::propagate_sweep(Output* output) const
 {
 	bool did_change = false;
 
@@ -72,48 +240,81 @@ bool OverlappingModel::propagate(Output* output) const
 			if (!output->_changes.get(x1, y1)) { continue; }
 			output->_changes.set(x1, y1, false);
 
-			for (int dx = -_n + 1; dx < _n; ++dx) {
-				for (int dy = -_n + 1; dy < _n; ++dy) {
-					auto x2 = x1 + dx;
-					auto y2 = y1 + dy;
+			for (size_t d = 0; d < _offsets.size(); ++d) {
+				auto x2 = x1 + _offsets[d][0];
+				auto y2 = y1 + _offsets[d][1];
 
-					auto sx = x2;
-					if      (sx <  0)      { sx += _width; }
-					else if (sx >= _width) { sx -= _width; }
+				auto sx = x2;
+				if      (sx <  0)      { sx += _width; }
+				else if (sx >= _width) { sx -= _width; }
 
-					auto sy = y2;
-					if      (sy <  0)       { sy += _height; }
-					else if (sy >= _height) { sy -= _height; }
+				auto sy = y2;
+				if      (sy <  0)       { sy += _height; }
+				else if (sy >= _height) { sy -= _height; }
 
-					if (!_periodic_out && (sx + _n > _width || sy + _n > _height)) {
-						continue;
+				if (!_periodic_out && (sx + _n > _width || sy + _n > _height)) {
+					continue;
+				}
+				WFC_COUNT(output, cells_visited, 1);
+
+				output->_wave.for_each(sx, sy, [&](size_t t2) {
+					bool can_pattern_fit = false;
+
+					const auto prop = propagator(t2, opposite_direction(d));
+					size_t num_scanned = 0;
+					for (const auto& t3 : prop) {
+						num_scanned += 1;
+						if (output->_wave.get(x1, y1, t3)) {
+							can_pattern_fit = true;
+							break;
+						}
 					}
+					WFC_COUNT(output, entries_scanned, num_scanned);
 
-					for (int t2 = 0; t2 < _num_patterns; ++t2) {
-						if (!output->_wave.get(sx, sy, t2)) { continue; }
+					if (!can_pattern_fit) {
+						ban(output, sx, sy, t2);
+						did_change = true;
+					}
+				});
+			}
+		}
+	}
 
-						bool can_pattern_fit = false;
+	return did_change;
+}
 
-						const auto& prop = _propagator.ref(t2, _n - 1 - dx, _n - 1 - dy);
-						for (const auto& t3 : prop) {
-							if (output->_wave.get(x1, y1, t3)) {
-								can_pattern_fit = true;
-								break;
-							}
-						}
+bool OverlappingModel::is_consistent(const Output& output) const
+{
+	// Check all overlapping offsets, whichever ones we propagate along:
+	for (int x1 = 0; x1 < _width; ++x1) {
+		for (int y1 = 0; y1 < _height; ++y1) {
+			if (on_boundary(x1, y1) || output._wave.count(x1, y1) != 1) { continue; }
+			const size_t t1 = find_first_bit(output._wave.words(x1, y1), output._wave.num_words());
 
-						if (!can_pattern_fit) {
-							output->_changes.set(sx, sy, true);
-							output->_wave.set(sx, sy, t2, false);
-							did_change = true;
-						}
+			for (int dx = -_n + 1; dx < _n; ++dx) {
+				for (int dy = -_n + 1; dy < _n; ++dy) {
+					int sx = x1 + dx;
+					int sy = y1 + dy;
+
+					if (_periodic_out) {
+						sx = (sx + _width)  % _width;
+						sy = (sy + _height) % _height;
+					} else if (sx < 0 || sy < 0 || on_boundary(sx, sy)) {
+						continue;
+					}
+
+					if (output._wave.count(sx, sy) != 1) { continue; }
+					const size_t t2 = find_first_bit(output._wave.words(sx, sy), output._wave.num_words());
+
+					if (!agrees(t1, t2, dx, dy)) {
+						return false;
 					}
 				}
 			}
 		}
 	}
 
-	return did_change;
+	return true;
 }
 
 Graphics OverlappingModel::graphics(const Output& output) const
@@ -133,11 +334,9 @@ Graphics OverlappingModel::graphics(const Output& output) const
 
 					if (on_boundary(sx, sy)) { continue; }
 
-					for (int t = 0; t < _num_patterns; ++t) {
-						if (output._wave.get(sx, sy, t)) {
-							tile_constributors.push_back(_patterns[t][dx + dy * _n]);
-						}
-					}
+					output._wave.for_each(sx, sy, [&](size_t t) {
+						tile_constributors.push_back(_patterns[t][dx + dy * _n]);
+					});
 				}
 			}
 		}
@@ -182,4 +381,13 @@ Image image_from_graphics(const Graphics& graphics, const Palette& palette)
 Image OverlappingModel::image(const Output& output) const
 {
 	return upsample(image_from_graphics(graphics(output), _palette));
+}
+
+ModelReport OverlappingModel::report() const
+{
+	ModelReport report = output_report(_offsets.size());
+	report.propagator_entries = _propagator.num_values();
+	report.propagator_bytes   = _propagator.num_values() * sizeof(PatternIndex)
+	                          + (_propagator.num_lists() + 1) * sizeof(uint32_t);
+	return report;
 }
\ No newline at end of file
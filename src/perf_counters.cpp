@@ -0,0 +1,117 @@
+#include "perf_counters.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <loguru.hpp>
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+const char* perf_event2str(PerfEvent event)
+{
+	switch (event) {
+		case PerfEvent::kCycles:       return "cycles";
+		case PerfEvent::kInstructions: return "instructions";
+		case PerfEvent::kCacheMisses:  return "cache_misses";
+		case PerfEvent::kBranchMisses: return "branch_misses";
+	}
+	return "unknown";
+}
+
+#ifdef __linux__
+
+PerfCounters::PerfCounters()
+{
+	const uint64_t configs[kNumPerfEvents] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+
+	// One group, so all events are counted over the same time, and read with one syscall.
+	for (size_t i = 0; i < kNumPerfEvents; ++i) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size           = sizeof(attr);
+		attr.type           = PERF_TYPE_HARDWARE;
+		attr.config         = configs[i];
+		attr.disabled       = i == 0; // The leader starts the whole group.
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+		attr.read_format    = PERF_FORMAT_GROUP;
+
+		_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : _fds[0], 0);
+		if (_fds[i] < 0) {
+			LOG_F(WARNING, "perf_event_open failed for %s: %s. Measuring wall time only.",
+			      perf_event2str(static_cast<PerfEvent>(i)), strerror(errno));
+			for (size_t j = 0; j < i; ++j) {
+				close(_fds[j]);
+			}
+			return;
+		}
+	}
+
+	_group_fd = _fds[0];
+	ioctl(_group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(_group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	// The least of a few tries, so an interrupt in one of them does not count.
+	std::fill(_read_cost, _read_cost + kNumPerfEvents, std::numeric_limits<uint64_t>::max());
+	for (int i = 0; i < 100; ++i) {
+		uint64_t before[kNumPerfEvents], after[kNumPerfEvents];
+		if (!read(before) || !read(after)) {
+			std::fill(_read_cost, _read_cost + kNumPerfEvents, 0);
+			break;
+		}
+		for (size_t j = 0; j < kNumPerfEvents; ++j) {
+			_read_cost[j] = std::min(_read_cost[j], after[j] - before[j]);
+		}
+	}
+}
+
+PerfCounters::~PerfCounters()
+{
+	if (!ok()) { return; }
+	for (const int fd : _fds) {
+		close(fd);
+	}
+}
+
+bool PerfCounters::read(uint64_t values[kNumPerfEvents]) const
+{
+	if (!ok()) { return false; }
+
+	// With PERF_FORMAT_GROUP: the number of events, then the value of each.
+	uint64_t buffer[1 + kNumPerfEvents];
+	if (::read(_group_fd, buffer, sizeof(buffer)) != sizeof(buffer) || buffer[0] != kNumPerfEvents) {
+		return false;
+	}
+	for (size_t i = 0; i < kNumPerfEvents; ++i) {
+		values[i] = buffer[1 + i];
+	}
+	return true;
+}
+
+#else // __linux__
+
+PerfCounters::PerfCounters()
+{
+	LOG_F(WARNING, "Hardware performance counters are only supported on Linux. Measuring wall time only.");
+}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::read(uint64_t values[kNumPerfEvents]) const
+{
+	return false;
+}
+
+#endif // __linux__
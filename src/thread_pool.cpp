@@ -0,0 +1,107 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+
+// Which pool and worker the current thread belongs to, if any.
+static thread_local ThreadPool* t_pool         = nullptr;
+static thread_local size_t      t_worker_index = 0;
+
+ThreadPool::ThreadPool(size_t num_threads)
+{
+	num_threads = std::max<size_t>(num_threads, 1);
+	for (size_t i = 0; i < num_threads; ++i) {
+		_queues.emplace_back(new Queue);
+	}
+	for (size_t i = 0; i < num_threads; ++i) {
+		_threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::push(Task task)
+{
+	size_t index;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (t_pool == this) {
+			index = t_worker_index;
+		} else {
+			index = _next_queue;
+			_next_queue = (_next_queue + 1) % _queues.size();
+		}
+		_num_pending += 1;
+		_num_queued  += 1;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+		_queues[index]->tasks.push_back(std::move(task));
+	}
+	_wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this] { return _num_pending == 0; });
+}
+
+bool ThreadPool::pop(size_t index, Task* out_task)
+{
+	for (size_t i = 0; i < _queues.size(); ++i) {
+		const size_t victim = (index + i) % _queues.size();
+		auto& queue = *_queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) { continue; }
+
+		if (victim == index) {
+			*out_task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			*out_task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::work(size_t index)
+{
+	t_pool         = this;
+	t_worker_index = index;
+
+	for (;;) {
+		Task task;
+		if (pop(index, &task)) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_num_queued -= 1;
+			}
+
+			task();
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_num_pending -= 1;
+			if (_num_pending == 0) {
+				_idle.notify_all();
+			}
+		} else {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this] { return _stop || _num_queued > 0; });
+			if (_stop) { return; }
+		}
+	}
+}
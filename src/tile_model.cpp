@@ -12,11 +12,13 @@ Tile rotate(const Tile& in_tile, const size_t tile_size)
 	return out_tile;
 }
 
-TileModel::TileModel(const configuru::Config& config, std::string subset_name, int width, int height, bool periodic_out, const TileLoader& tile_loader)
+TileModel::TileModel(const configuru::Config& config, std::string subset_name, int width, int height, bool periodic_out,
+                     Propagation propagation, const TileLoader& tile_loader)
 {
 	_width        = width;
 	_height       = height;
 	_periodic_out = periodic_out;
+	_propagation  = propagation;
 
 	_tile_size        = config.get_or("tile_size", 16);
 	const bool unique = config.get_or("unique",    false);
@@ -106,8 +108,13 @@ TileModel::TileModel(const configuru::Config& config, std::string subset_name, i
 	}
 
 	_num_patterns = action.size();
+	CHECK_F(_num_patterns <= std::numeric_limits<PatternIndex>::max(), "Too many patterns: %lu", _num_patterns);
 
-	_propagator = Array3D<Bool>(4, _num_patterns, _num_patterns, false);
+	for (const double weight : _pattern_weight) {
+		_weight_log_weight.push_back(weight > 0 ? weight * std::log(weight) : 0.0);
+	}
+
+	_propagator = BitArray3D(4, _num_patterns, _num_patterns, false);
 
 	for (const auto& neighbor : config["neighbors"].as_array()) {
 		const auto left  = neighbor["left"];
@@ -142,9 +149,76 @@ TileModel::TileModel(const configuru::Config& config, std::string subset_name, i
 			_propagator.set(3, t1, t2, _propagator.get(1, t2, t1));
 		}
 	}
+
+	if (_propagation == Propagation::kQueue) {
+		_initial_compatible = Array2D<SupportCount>(_num_patterns, 4, 0);
+		for (int d = 0; d < 4; ++d) {
+			for (int t1 = 0; t1 < _num_patterns; ++t1) {
+				_propagator.for_each(d, t1, [&](size_t t2) {
+					_agrees.push_back(t2);
+					_initial_compatible.mut_ref(t2, d) += 1;
+				});
+				_agrees.end_list();
+			}
+		}
+		_agrees.shrink_to_fit();
+	}
 }
 
 bool TileModel::propagate(Output* output) const
+{
+	WFC_COUNT(output, propagate_calls, 1);
+	if (_propagation == Propagation::kQueue) {
+		return propagate_queue(output);
+	} else {
+		return propagate_sweep(output);
+	}
+}
+
+bool TileModel::propagate_queue(Output* output) const
+{
+	bool did_change = false;
+
+	while (!output->_stack.empty()) {
+		const Ban banned = output->_stack.back();
+		output->_stack.pop_back();
+		did_change = true;
+
+		for (int d = 0; d < 4; ++d) {
+			int x2, y2;
+			if (!neighbor(banned.x, banned.y, d, &x2, &y2)) { continue; }
+
+			const auto supported = agrees(d, banned.t);
+			WFC_COUNT(output, cells_visited, 1);
+			WFC_COUNT(output, support_checks, supported.size());
+
+			for (const auto t2 : supported) {
+				auto& compatible = output->_compatible.mut_ref(x2 * _height + y2, t2, d);
+				DCHECK_F(compatible > 0, "Support of pattern %u lost twice", unsigned(t2));
+				compatible -= 1;
+				if (compatible == 0 && output->_wave.get(x2, y2, t2)) {
+					ban(output, x2, y2, t2);
+				}
+			}
+		}
+	}
+
+	return did_change;
+}
+
+void TileModel::restore_support(Output* output, const Ban& banned) const
+{
+	for (int d = 0; d < 4; ++d) {
+		int x2, y2;
+		if (!neighbor(banned.x, banned.y, d, &x2, &y2)) { continue; }
+
+		for (const auto t2 : agrees(d, banned.t)) {
+			output->_compatible.mut_ref(x2 * _height + y2, t2, d) += 1;
+		}
+	}
+}
+
+bool TileModel::propagate_sweep(Output* output) const
 {
 	bool did_change = false;
 
@@ -183,22 +257,21 @@ bool TileModel::propagate(Output* output) const
 				}
 
 				if (!output->_changes.get(x1, y1)) { continue; }
-
-				for (int t2 = 0; t2 < _num_patterns; ++t2) {
-					if (output->_wave.get(x2, y2, t2)) {
-						bool b = false;
-						for (int t1 = 0; t1 < _num_patterns && !b; ++t1) {
-							if (output->_wave.get(x1, y1, t1)) {
-								b = _propagator.get(d, t1, t2);
-							}
-						}
-						if (!b) {
-							output->_wave.set(x2, y2, t2, false);
-							output->_changes.set(x2, y2, true);
-							did_change = true;
-						}
+				WFC_COUNT(output, cells_visited, 1);
+
+				const Word* wave1 = output->_wave.words(x1, y1);
+				const size_t num_words = output->_wave.num_words();
+
+				output->_wave.for_each(x2, y2, [&](size_t t2) {
+					// Every t1 with _propagator.get(d, t1, t2), i.e. _propagator.get(opposite, t2, t1):
+					const Word* supports = _propagator.words((d + 2) % 4, t2);
+					const bool b = any_and(wave1, supports, num_words);
+					WFC_COUNT(output, support_checks, 1);
+					if (!b) {
+						ban(output, x2, y2, t2);
+						did_change = true;
 					}
-				}
+				});
 			}
 		}
 	}
@@ -206,6 +279,37 @@ bool TileModel::propagate(Output* output) const
 	return did_change;
 }
 
+bool TileModel::is_consistent(const Output& output) const
+{
+	// Directions 2 and 3 are the transposes of 0 and 1, so checking 0 and 1 covers all pairs.
+	for (int x2 = 0; x2 < _width; ++x2) {
+		for (int y2 = 0; y2 < _height; ++y2) {
+			if (output._wave.count(x2, y2) != 1) { continue; }
+			const size_t t2 = find_first_bit(output._wave.words(x2, y2), output._wave.num_words());
+
+			for (int d = 0; d < 2; ++d) {
+				int x1 = d == 0 ? x2 - 1 : x2;
+				int y1 = d == 0 ? y2     : y2 + 1;
+
+				if (x1 < 0 || y1 >= _height) {
+					if (!_periodic_out) { continue; }
+					x1 = (x1 + _width) % _width;
+					y1 = y1 % _height;
+				}
+
+				if (output._wave.count(x1, y1) != 1) { continue; }
+				const size_t t1 = find_first_bit(output._wave.words(x1, y1), output._wave.num_words());
+
+				if (!_propagator.get(d, t1, t2)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
 Image TileModel::image(const Output& output) const
 {
 	Image result(_width * _tile_size, _height * _tile_size, {});
@@ -213,11 +317,9 @@ Image TileModel::image(const Output& output) const
 	for (int x = 0; x < _width; ++x) {
 		for (int y = 0; y < _height; ++y) {
 			double sum = 0;
-			for (const auto t : irange(_num_patterns)) {
-				if (output._wave.get(x, y, t)) {
-					sum += _pattern_weight[t];
-				}
-			}
+			output._wave.for_each(x, y, [&](size_t t) {
+				sum += _pattern_weight[t];
+			});
 
 			for (int yt = 0; yt < _tile_size; ++yt) {
 				for (int xt = 0; xt < _tile_size; ++xt) {
@@ -225,15 +327,13 @@ Image TileModel::image(const Output& output) const
 						result.set(x * _tile_size + xt, y * _tile_size + yt, RGBA{0, 0, 0, 255});
 					} else {
 						double r = 0, g = 0, b = 0, a = 0;
-						for (int t = 0; t < _num_patterns; ++t) {
-							if (output._wave.get(x, y, t)) {
-								RGBA c = _tiles[t][xt + yt * _tile_size];
-								r += (double)c.r * _pattern_weight[t] / sum;
-								g += (double)c.g * _pattern_weight[t] / sum;
-								b += (double)c.b * _pattern_weight[t] / sum;
-								a += (double)c.a * _pattern_weight[t] / sum;
-							}
-						}
+						output._wave.for_each(x, y, [&](size_t t) {
+							RGBA c = _tiles[t][xt + yt * _tile_size];
+							r += (double)c.r * _pattern_weight[t] / sum;
+							g += (double)c.g * _pattern_weight[t] / sum;
+							b += (double)c.b * _pattern_weight[t] / sum;
+							a += (double)c.a * _pattern_weight[t] / sum;
+						});
 
 						result.set(x * _tile_size + xt, y * _tile_size + yt,
 						           RGBA{(uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a});
@@ -244,4 +344,20 @@ Image TileModel::image(const Output& output) const
 	}
 
 	return result;
+}
+
+ModelReport TileModel::report() const
+{
+	ModelReport report = output_report(4);
+	for (int d = 0; d < 4; ++d) {
+		for (size_t t1 = 0; t1 < _num_patterns; ++t1) {
+			report.propagator_entries += count_bits(_propagator.words(d, t1), _propagator.num_words());
+		}
+	}
+	report.propagator_bytes = 4 * _num_patterns * _propagator.num_words() * sizeof(Word);
+	if (_propagation == Propagation::kQueue) {
+		report.propagator_bytes += _agrees.num_values() * sizeof(PatternIndex)
+		                         + (_agrees.num_lists() + 1) * sizeof(uint32_t);
+	}
+	return report;
 }
\ No newline at end of file
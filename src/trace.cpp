@@ -0,0 +1,117 @@
+#include "trace.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <loguru.hpp>
+
+// Beyond this, a thread drops its phase events rather than run out of memory on a long run.
+const size_t kMaxPhaseEventsPerThread = 1 << 20;
+
+struct TraceEvent
+{
+	const char* name;
+	int64_t     begin_ns;
+	int64_t     end_ns;
+	std::string args;
+};
+
+struct TraceBuffer
+{
+	size_t                  tid;
+	std::vector<TraceEvent> events;
+	size_t                  num_phases  = 0; // Phase events in events.
+	size_t                  num_dropped = 0; // Phase events not in events.
+};
+
+// Every buffer ever made. Only touched when a thread records its first event, and when writing.
+static std::mutex                                s_buffers_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> s_buffers;
+
+static const auto s_start_time = std::chrono::steady_clock::now();
+
+int64_t trace_now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start_time).count();
+}
+
+// Owned by s_buffers, so the events outlive the thread.
+static TraceBuffer& thread_buffer()
+{
+	static thread_local TraceBuffer* buffer = nullptr;
+	if (!buffer) {
+		std::lock_guard<std::mutex> lock(s_buffers_mutex);
+		s_buffers.emplace_back(new TraceBuffer);
+		buffer = s_buffers.back().get();
+		buffer->tid = s_buffers.size() - 1;
+	}
+	return *buffer;
+}
+
+void record_trace_event(TraceKind kind, const char* name, int64_t begin_ns, int64_t end_ns, std::string args)
+{
+	TraceBuffer& buffer = thread_buffer();
+	if (kind == TraceKind::kPhase) {
+		if (buffer.num_phases >= kMaxPhaseEventsPerThread) {
+			buffer.num_dropped += 1;
+			return;
+		}
+		buffer.num_phases += 1;
+	}
+	buffer.events.push_back(TraceEvent{name, begin_ns, end_ns, std::move(args)});
+}
+
+std::string json_string(const std::string& str)
+{
+	std::string result = "\"";
+	for (const char c : str) {
+		if (c == '"' || c == '\\') {
+			result += '\\';
+			result += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			result += escaped;
+		} else {
+			result += c;
+		}
+	}
+	result += '"';
+	return result;
+}
+
+bool write_trace_json(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(s_buffers_mutex);
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) { return false; }
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	for (const auto& buffer : s_buffers) {
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, "
+		        "\"args\": {\"name\": \"thread %lu\"}}", first ? "" : ",\n", buffer->tid, buffer->tid);
+		first = false;
+
+		for (const auto& event : buffer->events) {
+			fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %lu, \"ts\": %.3f, \"dur\": %.3f",
+			        event.name, buffer->tid, event.begin_ns / 1e3, (event.end_ns - event.begin_ns) / 1e3);
+			if (!event.args.empty()) {
+				fprintf(file, ", \"args\": {%s}", event.args.c_str());
+			}
+			fprintf(file, "}");
+		}
+
+		if (buffer->num_dropped > 0) {
+			LOG_F(WARNING, "Trace: thread %lu dropped %lu phase events after the first %lu",
+			      buffer->tid, buffer->num_dropped, kMaxPhaseEventsPerThread);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}